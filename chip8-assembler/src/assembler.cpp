@@ -177,7 +177,7 @@ token assembler::parser::parserMatch(token_type expected)
 			return currentToken;
 		}
 	}
-	return token_t();
+	return noToken();
 }
 
 token assembler::parser::parserRequire(token_type expected) 
@@ -27,6 +27,11 @@ SOFTWARE.
 #define ASSEMBLER_H
 
 #include "program.hpp"
+#include <cstring>
+
+#ifndef _MSC_VER
+#define _strdup strdup // The POSIX name
+#endif
 
 namespace assembler
 {
@@ -59,6 +64,13 @@ namespace assembler
 	};
 	typedef token_t const& token;
 
+	// Empty argument. Tokens are passed by reference, so it can't be a temporary
+	inline token noToken()
+	{
+		static token_t const none;
+		return none;
+	}
+
 	shared_ptr<vector<token_t>> tokenize(shared_ptr<vector<string>> const& file);
 
 	typedef map<string, pair<dbyte, dbyte>> context_t; // First is addres, second is value
@@ -72,9 +84,9 @@ namespace assembler
 		token arg2;
 		token arg3;
 	public:
-		expression(token cmd) : cmd(cmd), arg1(token_t()), arg2(token_t()), arg3(token_t()) {}
-		expression(token cmd, token arg1) : cmd(cmd), arg1(arg1), arg2(token_t()), arg3(token_t()) {}
-		expression(token cmd, token arg1, token arg2) : cmd(cmd), arg1(arg1), arg2(arg2), arg3(token_t()) {}
+		expression(token cmd) : cmd(cmd), arg1(noToken()), arg2(noToken()), arg3(noToken()) {}
+		expression(token cmd, token arg1) : cmd(cmd), arg1(arg1), arg2(noToken()), arg3(noToken()) {}
+		expression(token cmd, token arg1, token arg2) : cmd(cmd), arg1(arg1), arg2(arg2), arg3(noToken()) {}
 		expression(token cmd, token arg1, token arg2, token arg3) : cmd(cmd), arg1(arg1), arg2(arg2), arg3(arg3) {}
 
 		virtual int codegen(context scope);
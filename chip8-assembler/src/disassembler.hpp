@@ -27,10 +27,11 @@ SOFTWARE.
 #define DISASSEMBLER_H
 
 #include "program.hpp"
+#include "../../chip8-emulator/src/chip8/isa.hpp" // Shared with the emulator
 
 namespace assembler
 {
-	string disasmCode(int code);
+	string disasmCode(int code); // In the assembler's syntax, see isa::format for no allocations
 }
 
 #endif
\ No newline at end of file
@@ -82,7 +82,9 @@ int main(int argc, char** argv)
 			char byte2;
 			input.read(&byte1, 1);
 			input.read(&byte2, 1);
-			output << assembler::disasmCode((byte1 & 0xFF) * 0x100 + (byte2 & 0xFF)) << endl;
+			char text[isa::TEXT_SIZE];
+			isa::format((uint16_t)((byte1 & 0xFF) * 0x100 + (byte2 & 0xFF)), text);
+			output << text << endl;
 		}
 
 		input.close();
@@ -0,0 +1,428 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// chip8-bench - microbenchmarks of the hot paths: emulateCycle on instruction mixes,
+// sprite drawing, both disassemblers and both assemblers on a generated source.
+// Prints nanoseconds per operation, writes them as JSON and compares with a JSON
+// written by an earlier build.
+
+#include "../common.h"
+#include "../chip8/CHIP8.hpp"
+#include "../chip8/CHIP8Batch.hpp"
+#include "../chip8/isa.hpp"
+#include "../../../chip8-assembler/src/assembler.hpp"
+#include "../../../chip8-assembler/src/disassembler.hpp"
+#include "../../../rewritten-chip8-asm/newc8asm.hpp"
+
+#include <functional>
+#include <map>
+
+#define ARGS_FIND(args, cmd) ((argIndex = find((args).begin(), (args).end(), cmd) - args.begin()) != (args).size())
+
+using namespace std;
+
+struct benchmark
+{
+	string name;
+	string unit; // What one operation is
+	function<unsigned long long()> batch; // Runs a batch, returns the operations done
+};
+
+struct measurement
+{
+	string name, unit;
+	double ns = 0; // Per operation, the fastest repetition
+	unsigned long long ops = 0; // Per repetition
+};
+
+static uint64_t sink; // Results go here so the compiler can't drop the work
+
+// Runs batches until ms have passed, the fastest of the repetitions is the least disturbed one
+static measurement measure(benchmark const& b, double ms, int repetitions)
+{
+	measurement m{ b.name, b.unit };
+	b.batch(); // Warm up caches and lazily built tables
+	for (int rep = 0; rep < repetitions; rep++)
+	{
+		unsigned long long ops = 0;
+		auto begin = chrono::steady_clock::now();
+		double elapsed = 0;
+		do
+		{
+			ops += b.batch();
+			elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+		} while (elapsed < ms);
+		double ns = elapsed * 1e6 / ops;
+		if (rep == 0 || ns < m.ns) m.ns = ns, m.ops = ops;
+	}
+	return m;
+}
+
+// A machine with code at 0x200 and data at 0x300
+static CHIP8::state program(vector<uint16_t> const& code, vector<uint8_t> const& data = {})
+{
+	CHIP8 c;
+	CHIP8::state s;
+	c.saveState(s);
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		s.ram[0x200 + i * 2] = code[i] >> 8;
+		s.ram[0x200 + i * 2 + 1] = code[i] & 0xFF;
+	}
+	copy(data.begin(), data.end(), s.ram.begin() + 0x300);
+	return s;
+}
+
+// perCall instructions per run(), the frontends call it once per frame with --ipf (10 by default)
+static benchmark cycles(string const& name, CHIP8::state const& s, CHIP8::engine e, unsigned long long perCall = 10000)
+{
+	auto c = make_shared<CHIP8>();
+	c->setEngine(e);
+	c->loadState(s);
+	bool stepped = e == CHIP8::engine::interpreter || e == CHIP8::engine::cached;
+	return { name, "instruction", [c, stepped, perCall]
+	{
+		unsigned long long const count = 10000;
+		if (stepped) for (unsigned long long i = 0; i < count; i++) c->emulateCycle();
+		else for (unsigned long long i = 0; i < count; i += perCall) c->run(perCall);
+		sink += c->getPC();
+		return count;
+	} };
+}
+
+// Every loop returns to 0x200 with jp, none is a jump to itself (an endless loop stops the machine)
+static map<string, vector<uint16_t>> const mixes =
+{
+	// ld, add, or, and, xor, sub, shr, subn, shl, add with carry
+	{ "alu", { 0x6005, 0x6107, 0x8014, 0x8011, 0x8122, 0x8013, 0x8015, 0x8106, 0x8017, 0x810E, 0x7003, 0x8104, 0x1200 } },
+	// call, se and sne that skip, se and sne that don't, ret
+	{ "branch", { 0x2210, 0x3000, 0x7000, 0x4001, 0x7000, 0x5010, 0x1200, 0x1200,
+		0x3001, 0x4000, 0x9010, 0x00EE } },
+	// ld I, bcd, store and load registers, add I, font
+	{ "memory", { 0xA300, 0xF033, 0xF365, 0xF755, 0x6004, 0xF01E, 0xF029, 0xF165, 0x1200 } },
+	// What a game loop looks like: ld, add, rnd, se, draw, ld I, key check
+	{ "mixed", { 0x6000, 0x610A, 0xC03F, 0x7101, 0x411F, 0x6100, 0xA300, 0xD015, 0xE09E, 0x7201, 0xF207, 0x3200, 0x7000, 0x1200 } },
+};
+
+// A mix in every lane of a CHIP8Batch. Lanes with the same seed stay together through rnd
+// and run as vectors, their own seeds split them into groups
+static benchmark batch(string const& name, vector<uint16_t> const& code, bool sameSeeds)
+{
+	int const lanes = 32;
+	auto b = make_shared<CHIP8Batch>(lanes);
+	if (!sameSeeds) for (int lane = 0; lane < lanes; lane++) b->setSeed(lane, lane);
+	vector<CHIP8::byte> rom;
+	for (uint16_t word : code)
+	{
+		rom.push_back(word >> 8);
+		rom.push_back(word & 0xFF);
+	}
+	b->load(rom);
+	return { name, "lane-instr", [b, lanes]
+	{
+		unsigned long long const count = 1000;
+		b->run(count);
+		sink += b->getPC(0);
+		return count * lanes;
+	} };
+}
+
+// A loop of ld I, draw, jp: drawAlgorithm at each height and alignment, wrapping the edges or not
+static benchmark draw(int height, int x, int y, string const& where)
+{
+	vector<uint8_t> sprite(15);
+	for (size_t i = 0; i < sprite.size(); i++) sprite[i] = (uint8_t)(0xA5 ^ i * 0x11);
+	auto c = make_shared<CHIP8>();
+	c->loadState(program({ (uint16_t)(0x6000 | x), (uint16_t)(0x6100 | y), 0xA300, (uint16_t)(0xD010 | height), 0x1206 }, sprite));
+	for (int i = 0; i < 3; i++) c->emulateCycle();
+	return { "draw/" + to_string(height) + "/" + where, "draw", [c]
+	{
+		unsigned long long const count = 10000;
+		for (unsigned long long i = 0; i < count; i++)
+		{
+			c->emulateCycle();
+			c->emulateCycle();
+		}
+		sink += c->displayRow(0);
+		return count;
+	} };
+}
+
+static benchmark disassembler(string const& name, function<string(int)> disasm)
+{
+	return { name, "opcode", [disasm]
+	{
+		for (int code = 0; code <= 0xFFFF; code++) sink += disasm(code).size();
+		return 0x10000ULL;
+	} };
+}
+
+// The same code over and over with other labels, filling the memory: ~1700 instructions,
+// with labels, jumps and comments. Both assemblers take it (assembler::tokenize stops at
+// an empty line)
+static vector<string> generateSource()
+{
+	vector<string> lines;
+	int block = 0;
+	for (int size = 0; size < 1700; block++)
+	{
+		string label = "block" + to_string(block);
+		lines.push_back("// Block " + to_string(block));
+		lines.push_back(label + ":");
+		for (string const& line : { "ld v0, 0x" + to_string(block % 10) + "F", string("ld v1, 12"), string("add v0, v1"),
+			string("se v0, 0x20 ; skip"), "jp [" + label + "]", string("ld I, [data]"), string("drw v0, v1, 5"),
+			string("sne vA, vB"), string("rnd v2, 0xFF"), string("ld [I], v5") })
+		{
+			lines.push_back("    " + line);
+			size++;
+		}
+	}
+	lines.push_back("data:");
+	lines.push_back("    dw 0xF0F0");
+	return lines;
+}
+
+static vector<benchmark> benchmarks(CHIP8::engine e, string const& engineName)
+{
+	vector<benchmark> res;
+	for (auto const& mix : mixes)
+	{
+		res.push_back(cycles("emulateCycle/" + mix.first, program(mix.second), CHIP8::engine::interpreter));
+		if (e != CHIP8::engine::interpreter)
+		{
+			res.push_back(cycles(engineName + "/" + mix.first, program(mix.second), e));
+			res.push_back(cycles(engineName + "/" + mix.first + "/ipf10", program(mix.second), e, 10));
+		}
+	}
+	for (auto const& mix : mixes) res.push_back(batch("CHIP8Batch/" + mix.first, mix.second, true));
+	res.push_back(batch("CHIP8Batch/mixed/seeds", mixes.at("mixed"), false));
+
+	for (int height : { 1, 8, 15 })
+	{
+		res.push_back(draw(height, 0, 0, "aligned"));
+		res.push_back(draw(height, 3, 5, "unaligned"));
+		res.push_back(draw(height, 60, 28, "wrapped"));
+	}
+
+	res.push_back(disassembler("CHIP8::disasmCode", CHIP8::disasmCode));
+	res.push_back(disassembler("assembler::disasmCode", assembler::disasmCode));
+	res.push_back({ "isa::format", "opcode", []
+	{
+		char text[isa::TEXT_SIZE];
+		for (int code = 0; code <= 0xFFFF; code++) sink += isa::format((uint16_t)code, text);
+		return 0x10000ULL;
+	} });
+	res.push_back({ "isa::text", "opcode", []
+	{
+		for (int code = 0; code <= 0xFFFF; code++) sink += isa::text((uint16_t)code)[0];
+		return 0x10000ULL;
+	} });
+
+	auto source = make_shared<vector<string>>(generateSource());
+	unsigned long long lines = source->size();
+	res.push_back({ "assembler::tokenize", "line", [source, lines]
+	{
+		sink += assembler::tokenize(source)->size();
+		return lines;
+	} });
+	res.push_back({ "assembler::assemble", "line", [source, lines]
+	{
+		auto tokens = assembler::tokenize(source);
+		assembler::context_t scope;
+		assembler::parser mainParser(tokens, scope);
+		assembler::program mainProgram = mainParser.parse();
+		for (auto const& ex : *mainProgram) sink += ex->codegen(scope);
+		return lines;
+	} });
+	res.push_back({ "c8asm::tokenize", "line", [source, lines]
+	{
+		sink += c8asm::tokenize(*source)->size();
+		return lines;
+	} });
+	auto tokens = c8asm::tokenize(*source);
+	res.push_back({ "c8asm::generator::generateBytes", "line", [tokens, lines]
+	{
+		c8asm::generator gen(tokens);
+		sink += gen.generateBytes()->size();
+		return lines;
+	} });
+	return res;
+}
+
+static void writeJson(ostream& out, vector<measurement> const& results)
+{
+	// One benchmark per line, readBaseline() depends on it
+	out << "{ \"benchmarks\": [" << endl;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		out << "  { \"name\": \"" << results[i].name << "\", \"unit\": \"" << results[i].unit
+			<< "\", \"ns\": " << fixed << setprecision(3) << results[i].ns << ", \"ops\": " << results[i].ops << " }"
+			<< (i + 1 < results.size() ? "," : "") << endl;
+	}
+	out << "] }" << endl;
+}
+
+static bool readBaseline(string const& path, map<string, double>& baseline)
+{
+	ifstream in(path);
+	if (!in) return false;
+	string line;
+	while (getline(in, line))
+	{
+		size_t name = line.find("\"name\": \""), ns = line.find("\"ns\": ");
+		if (name == string::npos || ns == string::npos) continue;
+		name += 9;
+		baseline[line.substr(name, line.find('"', name) - name)] = stod(line.substr(ns + 6));
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> args;
+	size_t argIndex; // Macros requirement
+	for (int i = 0; i < argc; i++)
+	{
+		args.push_back(argv[i]);
+	}
+
+	if (ARGS_FIND(args, "-h") || ARGS_FIND(args, "--help"))
+	{
+		cout << "Usage: " << endl
+			<< "  -h [ --help ]              shows this message" << endl
+			<< "  --filter text              run only the benchmarks with text in the name" << endl
+			<< "  -e [ --engine ] name       also run the instruction mixes with cached, block or jit" << endl
+			<< "  --time ms (=100)           time of a repetition" << endl
+			<< "  --repeat N (=5)            repetitions, the fastest counts" << endl
+			<< "  --json file                write the results as JSON (- for stdout)" << endl
+			<< "  --baseline file            compare with JSON written by --json" << endl
+			<< "  --threshold N (=10)        percent slower than the baseline that fails" << endl;
+		return 0;
+	}
+
+	bool filterFound = ARGS_FIND(args, "--filter");
+	size_t filterIndex = argIndex + 1;
+	bool engineFound = ARGS_FIND(args, "-e") || ARGS_FIND(args, "--engine");
+	size_t engineIndex = argIndex + 1;
+	bool timeFound = ARGS_FIND(args, "--time");
+	size_t timeIndex = argIndex + 1;
+	bool repeatFound = ARGS_FIND(args, "--repeat");
+	size_t repeatIndex = argIndex + 1;
+	bool jsonFound = ARGS_FIND(args, "--json");
+	size_t jsonIndex = argIndex + 1;
+	bool baselineFound = ARGS_FIND(args, "--baseline");
+	size_t baselineIndex = argIndex + 1;
+	bool thresholdFound = ARGS_FIND(args, "--threshold");
+	size_t thresholdIndex = argIndex + 1;
+
+	if ((filterFound && filterIndex >= args.size()) || (engineFound && engineIndex >= args.size())
+		|| (timeFound && timeIndex >= args.size()) || (repeatFound && repeatIndex >= args.size())
+		|| (jsonFound && jsonIndex >= args.size()) || (baselineFound && baselineIndex >= args.size())
+		|| (thresholdFound && thresholdIndex >= args.size()))
+	{
+		cout << "ERROR: No value specified" << endl;
+		return 1;
+	}
+
+	double ms = 100, threshold = 10;
+	int repetitions = 5;
+	try
+	{
+		if (timeFound) ms = stod(args[timeIndex]);
+		if (repeatFound) repetitions = stoi(args[repeatIndex]);
+		if (thresholdFound) threshold = stod(args[thresholdIndex]);
+	}
+	catch (logic_error const& e)
+	{
+		cout << "ERROR: Got invalid argument" << endl;
+		return 1;
+	}
+	if (ms <= 0 || repetitions <= 0)
+	{
+		cout << "ERROR: Time and repetitions must be positive" << endl;
+		return 1;
+	}
+
+	CHIP8::engine e = CHIP8::engine::interpreter;
+	string engineName = engineFound ? args[engineIndex] : "interpreter";
+	if (engineName == "cached") e = CHIP8::engine::cached;
+	else if (engineName == "block") e = CHIP8::engine::block;
+	else if (engineName == "jit") e = CHIP8::engine::jit;
+	else if (engineName != "interpreter")
+	{
+		cout << "ERROR: Unknown engine " << engineName << endl;
+		return 1;
+	}
+
+	map<string, double> baseline;
+	if (baselineFound && !readBaseline(args[baselineIndex], baseline))
+	{
+		cout << "ERROR: Can't read baseline " << args[baselineIndex] << endl;
+		return 1;
+	}
+
+	// The table goes to stderr when the JSON takes stdout
+	ostream& table = jsonFound && args[jsonIndex] == "-" ? cerr : cout;
+	vector<measurement> results;
+	int slower = 0;
+	for (benchmark const& b : benchmarks(e, engineName))
+	{
+		if (filterFound && b.name.find(args[filterIndex]) == string::npos) continue;
+		measurement m = measure(b, ms, repetitions);
+		results.push_back(m);
+
+		table << left << setw(36) << m.name << right << fixed << setprecision(2) << setw(12) << m.ns << " ns/" << left << setw(12) << m.unit;
+		auto base = baseline.find(m.name);
+		if (base != baseline.end() && base->second > 0)
+		{
+			double change = (m.ns / base->second - 1) * 100;
+			table << right << setw(12) << base->second << " ns " << showpos << setprecision(1) << setw(7) << change << "%" << noshowpos;
+			if (change > threshold)
+			{
+				table << "  SLOWER";
+				slower++;
+			}
+		}
+		table << endl;
+	}
+
+	if (jsonFound)
+	{
+		if (args[jsonIndex] == "-") writeJson(cout, results);
+		else
+		{
+			ofstream out(args[jsonIndex]);
+			if (!out)
+			{
+				cout << "ERROR: Can't write " << args[jsonIndex] << endl;
+				return 1;
+			}
+			writeJson(out, results);
+		}
+	}
+	if (baselineFound)
+		table << slower << " of " << results.size() << " benchmarks more than " << threshold << "% slower than the baseline" << endl;
+	return slower ? 1 : 0;
+}
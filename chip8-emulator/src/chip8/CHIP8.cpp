@@ -24,8 +24,17 @@ SOFTWARE.
 */
 
 #include "CHIP8.hpp"
+#include "ops.hpp"
+#include "blocks.hpp"
+#include "jit.hpp"
+#include "aot.hpp"
+#include "rewind.hpp"
+#include "timeline.hpp"
+#include "loops.hpp"
+#include "isa.hpp"
 #include "../common.h"
-#include "../log/logger.hpp"
+
+#include <cstring>
 
 using namespace std;
 
@@ -53,163 +62,11 @@ string CHIP8::disasmCode(int code)
 {
     // Foolproof
     if (code > 0xFFFF) throw invalid_argument("The code is bigger than 2 bytes");
-
-    stringstream res;
-
-    if (code <= 0xFF)
-    {
-        if (code == 0xE0)
-        {
-            return "cls";
-        }
-        else if (code == 0xEE)
-        {
-            return "ret";
-        }
-        else
-        {
-            res << "dw 0x" << hex << code;
-            return res.str();
-        }
-    }
-
-    switch (code >> 12)
-    {
-    case 0x1:
-        res << "jmp 0x" << hex << (code & 0x0FFF);
-        break;
-    case 0x2:
-        res << "call 0x" << hex << (code & 0x0FFF);
-        break;
-    case 0x3:
-        res << "se V" << hex << ((code >> 8) & 0x0F) << ", 0x" << (code & 0x00FF);
-        break;
-    case 0x4:
-        res << "sne V" << hex << ((code >> 8) & 0x0F) << ", 0x" << (code & 0x00FF);
-        break;
-    case 0x5:
-        if((code & 0x000F) == 0)
-            res << "se V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-        else
-            res << "dw 0x" << hex << code;
-        break;
-    case 0x6:
-        res << "ld V" << hex << ((code >> 8) & 0x0F) << ", 0x" << (code & 0x00FF);
-        break;
-    case 0x7:
-        res << "add V" << hex << ((code >> 8) & 0x0F) << ", 0x" << (code & 0x00FF);
-        break;
-    case 0x8:
-        switch (code & 0x000F)
-        {
-        case 0x0:
-            res << "ld V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-            break;
-        case 0x1:
-            res << "or V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-            break;
-        case 0x2:
-            res << "and V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-            break;
-        case 0x3:
-            res << "xor V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-            break;
-        case 0x4:
-            res << "add V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-            break;
-        case 0x5:
-            res << "sub V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-            break;
-        case 0x6:
-            res << "shr V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0x7:
-            res << "subn V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4);
-            break;
-        case 0xE:
-            res << "shl V" << ((code >> 8) & 0x0F);
-            break;
-        default:
-            res << "dw 0x" << hex << code;
-            break;
-        }
-        break;
-    case 0x9:
-        res << "sne V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code >> 4) & 0x00F);
-        break;
-    case 0xA:
-        res << "ld I, " << hex << "0x" << (code & 0x0FFF);
-        break;
-    case 0xB:
-        res << "jp V0, " << hex << "0x" << (code & 0x0FF);
-        break;
-    case 0xC:
-        res << "rnd V" << hex << ((code >> 8) & 0x0F) << ", 0x" << (code & 0x00FF);
-        break;
-    case 0xD:
-        res << "drw V" << hex << ((code >> 8) & 0x0F) << ", V" << ((code & 0x00FF) >> 4) << ", " << (code & 0x000F);
-        break;
-    case 0xE:
-        switch (code & 0x00FF)
-        {
-        case 0x9E:
-            res << "skp V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0xA1:
-            res << "sknp V" << hex << ((code >> 8) & 0x0F);
-            break;
-        default:
-            res << "dw 0x" << hex << code;
-            break;
-        }
-        break;
-    case 0xF:
-        switch (code & 0x00FF)
-        {
-        case 0x07:
-            res << "ld V" << hex << ((code >> 8) & 0x0F) << ", DT";
-            break;
-        case 0x0A:
-            res << "ld V" << hex << ((code >> 8) & 0x0F) << ", K";
-            break;
-        case 0x15:
-            res << "ld DT, V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0x18:
-            res << "ld ST, V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0x1E:
-            res << "add I, V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0x29:
-            res << "ld F, V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0x33:
-            res << "ld B, V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0x55:
-            res << "ld [I], V" << hex << ((code >> 8) & 0x0F);
-            break;
-        case 0x65:
-            res << "ld V" << hex << ((code >> 8) & 0x0F) << ", [I]";
-            break;
-        default:
-            res << "dw 0x" << hex << code;
-            break;
-        }
-        break;
-    default:
-        res << "dw 0x" << hex << code;
-        break;
-    }
-
-    return res.str();
+    return isa::text((dbyte)code);
 }
 
 CHIP8::CHIP8()
 {
-    logger::debug("Initializing CHIP-8...");
-
 	refresh();
 
     fill(ram.begin(), ram.end(), 0);
@@ -229,21 +86,39 @@ bool CHIP8::drawAlgorithm(byte vx, byte vy, byte n)
     }
 
     bool collision = false;
+    uint32_t changed = 0;
+    int shift = vx % 64;
     for (int i = 0; i < n; i++)
     {
-        byte state = ram[I + i];
-        for (int j = 0; j < 8; j++)
-        {
-            if (state & (0b10000000 >> j))
-            {
-                collision = graphicsMap[(vy + i) % 32][(vx + j) % 64];
-                graphicsMap[(vy + i) % 32][(vx + j) % 64] ^= 1;
-            }
-        }
+        // Sprite row at x, wrapped around the right edge
+        uint64_t sprite = (uint64_t)ram[(I + i) & 0xFFF] << 56;
+        if (shift) sprite = sprite >> shift | sprite << (64 - shift);
+        int y = (vy + i) % 32;
+        uint64_t& row = graphicsMap[y];
+        collision |= (row & sprite) != 0;
+        row ^= sprite;
+        if (sprite) changed |= 1u << y;
     }
+    markRows(changed);
     return collision;
 }
 
+void CHIP8::clearDisplay()
+{
+    uint32_t changed = 0;
+    for (int y = 0; y < 32; y++)
+        if (graphicsMap[y]) changed |= 1u << y;
+    graphicsMap.fill(0);
+    markRows(changed);
+}
+
+void CHIP8::endFrame()
+{
+    if (frameGeneration == displayGeneration) return;
+    frameGeneration = displayGeneration;
+    if (frameCallback) frameCallback();
+}
+
 CHIP8::CHIP8(string currentPath)
 {
     fill(ram.begin(), ram.end(), 0);
@@ -257,13 +132,10 @@ CHIP8::CHIP8(string currentPath)
 
 bool CHIP8::reload(string newPath)
 {
-    logger::debug("Reloading CHIP-8...");
-
     refresh();
     romPath = newPath;
-    romFile.close();
     
-    romFile.open(romPath, ios::in | ios::binary);
+    ifstream romFile(romPath, ios::in | ios::binary);
     if (!romFile)
     {
         // TODO: Error handle
@@ -281,17 +153,16 @@ bool CHIP8::reload(string newPath)
     char b = 0;
     for (dbyte i = 0x200; romFile.get(b); i++)
         ram[i] = b;
+    romHash = aot::hash(ram.data() + 0x200, (size_t)length);
+    invalidateAll();
 
     return true;
 }
 
 void CHIP8::refresh()
 {
-    logger::debug("CHIP-8 refresh");
-    for (int i = 0; i < 32; i++)
-    {
-        fill(graphicsMap[i].begin(), graphicsMap[i].end(), false);
-    }
+    graphicsMap.fill(0);
+    markRows(0xFFFFFFFF);
 	fill(stack.begin(), stack.end(), 0);
 	fill(keys.begin(), keys.end(), false);
 	fill(v.begin(), v.end(), 0);
@@ -301,228 +172,278 @@ void CHIP8::refresh()
 	delayTimer = 0;
 	I = 0;
 	pc = 0x200;
-	code = 0;
+	rng.seed(seed);
     lastKey = -1;
+    cycles = 0;
+    invalidations = 0;
+    idleCycles = 0;
+    if (history) history->clear();
+    if (journal) journal->clear();
+    if (loops) loops->forget();
 
     endlessLoop = false;
 }
 
 CHIP8::~CHIP8()
 {
-    romFile.close();
 }
 
-void CHIP8::emulateCycle()
+void CHIP8::loadState(state const& in)
 {
-    if (endlessLoop) return;
+    restore(in);
+    if (journal) journal->rebase(*this);
+}
 
-    code = ram[pc] << 8 | ram[pc + 1];
-    pc += 2;
-    if (code == 0xE0) // CLS
-    {
-        for (int i = 0; i < 32; i++)
-        {
-            fill(graphicsMap[i].begin(), graphicsMap[i].end(), false);
-        }
-        return;
-    }
-    if (code == 0xEE)
+void CHIP8::restore(state const& in)
+{
+    // Compared 64 bytes at a time, code rarely differs between snapshots
+    for (int chunk = 0; chunk < 4096; chunk += 64)
     {
-        pc = stack[sp];
-        sp--;
-        return;
+        if (memcmp(&ram[chunk], &in.ram[chunk], 64) == 0) continue;
+        for (int addr = chunk; addr < chunk + 64; addr++)
+            if (ram[addr] != in.ram[addr]) invalidate(addr);
     }
+    uint32_t changed = 0;
+    for (int y = 0; y < 32; y++)
+        if (graphicsMap[y] != in.graphicsMap[y]) changed |= 1u << y;
+    static_cast<state&>(*this) = in;
+    markRows(changed);
+    if (loops) loops->reset(*this);
+}
 
-    byte nn = code & 0x00FF;
-    dbyte addr = code & 0x0FFF;
-    byte x = (code >> 8) & 0x0F;
-    byte y = (code >> 4) & 0x0F;
-    byte nibble = code & 0x000F;
+void CHIP8::recordFrame()
+{
+    if (!history) history = make_unique<rewind_buffer>();
+    history->record(*this);
+}
 
-    switch (code >> 12)
+void CHIP8::send(input const& in)
+{
+    input stamped = in;
+    stamped.cycle = cycles;
+    apply(stamped);
+    if (journal) journal->log(stamped);
+    if (inputCallback) inputCallback(stamped);
+}
+
+void CHIP8::apply(input const& in)
+{
+    switch (in.what)
     {
-    case 0x1: // JP addr
-        pc = addr;
-        if ((ram[pc] << 8 | ram[pc + 1]) == code)
-        {
-            endlessLoop = true;
-            infoInternal("Caught endless loop");
-        }
+    case input::KEY_DOWN:
+        keys[in.value & 0xF] = true;
+        lastKey = in.value & 0xF;
         break;
-    case 0x2: // CALL addr
-        sp++;
-        if (sp >= 16)
-        {
-            errorInternal("Stack overflow");
-        }
-        if (sp < 16) stack[sp] = pc;
-        pc = addr;
-        if ((ram[pc] << 8 | ram[pc + 1]) == code)
-        {
-            endlessLoop = true;
-            infoInternal("Caught endless loop");
-        }
+    case input::KEY_UP:
+        keys[in.value & 0xF] = false;
         break;
-    case 0x3: // SE Vx, byte
-        if (v[x] == nn)
-        {
-            pc += 2;
-        }
-        break;
-    case 0x4: // SNE Vx, byte
-        if (v[x] != nn)
-        {
-            pc += 2;
-        }
+    case input::CLEAR_LAST_KEY:
+        lastKey = -1;
         break;
-    case 0x5: // SE Vx, Vy
-        if ((v[x] == v[y]))
-        {
-            pc += 2;
-        }
+    case input::TICK_TIMERS:
+        if (delayTimer > 0) delayTimer--;
+        if (soundTimer > 0) soundTimer--;
         break;
-    case 0x6: // LD Vx, byte 
-        v[x] = nn;
-        //if (x == 0xf) logger::error("F:" + to_string(nn));
+    case input::SET_RAM:
+        ram[in.addr & 0xFFF] = in.value;
+        invalidate(in.addr);
         break;
-    case 0x7: // ADD Vx, byte
-        v[x] += nn;
+    case input::RESET_STOP:
+        endlessLoop = false;
         break;
-    case 0x8:
-        switch (code & 0x000F)
+    }
+}
+
+void CHIP8::setCheckpointInterval(unsigned long long interval)
+{
+    if (interval == 0) journal.reset();
+    else if (!journal) journal = make_unique<timeline>(interval);
+    else journal->interval = interval;
+}
+
+void CHIP8::setLoopDetection(bool on)
+{
+    if (!on) loops.reset();
+    else if (!loops) loops = make_unique<loop_detector>(*this);
+}
+
+CHIP8::code_range CHIP8::loopRange() const
+{
+    if (loops && endlessLoop && loops->range.start <= pc && pc <= loops->range.end) return loops->range;
+    return { pc, pc };
+}
+
+bool CHIP8::stepBack(unsigned long long count)
+{
+    if (!journal || count > cycles) return false;
+    return journal->seek(*this, cycles - count);
+}
+
+bool CHIP8::reverseContinue(dbyte breakpoint)
+{
+    return journal && journal->reverseContinue(*this, breakpoint);
+}
+
+int CHIP8::rewind(int frames)
+{
+    if (!history || history->size() == 0) return 0;
+
+    state s;
+    int rewound = history->rewind(frames, s);
+    // Keys stay as the player holds them now
+    s.keys = keys;
+    s.lastKey = -1;
+    loadState(s);
+    return rewound;
+}
+
+CHIP8::instruction const* CHIP8::decodeTable()
+{
+    // Built once: every 16-bit opcode with its handler and operands already extracted
+    static vector<instruction> const table = []
+    {
+        vector<instruction> res(0x10000);
+        for (int code = 0; code <= 0xFFFF; code++) res[code] = ops::decode(code);
+        return res;
+    }();
+    return table.data();
+}
+
+void CHIP8::emulateCycle()
+{
+    if (endlessLoop) return;
+    if (journal && cycles >= journal->nextCheckpoint) journal->take(*this);
+
+    cycles++;
+    instruction const* ins;
+    if (currentEngine == engine::cached)
+    {
+        instruction& slot = decoded[pc & 0xFFF];
+        if (!slot.exec) slot = opcodes[fetch(pc)];
+        ins = &slot;
+    }
+    else
+    {
+        ins = &opcodes[fetch(pc)];
+    }
+    pc += 2;
+    ins->exec(*this, *ins);
+}
+
+unsigned long long CHIP8::run(unsigned long long count)
+{
+    unsigned long long begin = cycles, end = cycles + count;
+    // Other engines don't go through emulateCycle, they checkpoint at most once per call
+    if (journal && cycles >= journal->nextCheckpoint && !endlessLoop) journal->take(*this);
+    // A period the detector traces is interpreted whatever the engine
+    if (loops && !endlessLoop && loops->sample(*this))
+        while (cycles < end && !endlessLoop && loops->trace(*this)) emulateCycle();
+    if (cycles >= end || endlessLoop) return cycles - begin;
+
+    if (currentEngine == engine::block)
+    {
+        if (!blocks) blocks = make_unique<block_cache>();
+        blocks->run(*this, end);
+    }
+    else if (currentEngine == engine::jit)
+    {
+        if (!jitted)
         {
-        case 0x0: // LD Vx, Vy
-            v[x] = v[y];
-            break;
-        case 0x1: // OR Vx, Vy
-            v[x] = v[x] | v[y];
-            break;
-        case 0x2: // AND Vx, Vy
-            v[x] = v[x] & v[y];
-            break;
-        case 0x3: // XOR Vx, Vy
-            v[x] = v[x] ^ v[y];
-            break;
-        case 0x4: // ADD Vx, Vy
-            v[0xF] = (v[x] + v[y]) > 0xFF;
-            v[x] += v[y];
-            break;
-        case 0x5: // SUB Vx, Vy
-            v[0xF] = v[x] > v[y];
-            v[x] -= v[y];
-            break;
-        case 0x6: // SHR Vx 
-            if (v[x] & 0b00000001) v[0xF] = 1;
-            else v[0xF] = 0;
-            v[x] = v[x] >> 1;
-            break;
-        case 0x7: // SUBN Vx, Vy
-            v[0xF] = v[y] > v[x];
-            v[x] = v[y] - v[x];
-            break;
-        case 0xE: // SHL Vx
-            if (v[x] & 0b10000000) v[0xF] = 1;
-            else v[0xF] = 0;
-            v[x] <<= 1;
-            break;
-        default:
-            errorInternal("Unknown opcode: " + type_to_hex(code));
-            break;
+            jitted = make_unique<jit_cache>();
+            if (!jitted->supported()) infoInternal("JIT isn't available here, interpreting");
         }
-        break;
-    case 0x9: // SNE Vx, Vy
-        if (v[x] != v[y])
+        jitted->run(*this, end);
+    }
+    else if (currentEngine == engine::aot)
+    {
+        if (!recompiled)
         {
-            pc += 2;
+            recompiled = make_unique<aot>();
+            recompiled->bind(*this);
         }
-        break;
-    case 0xA: // LD I, addr
-        I = addr;
-        break;
-    case 0xB: // JP V0, addr
-        pc = addr + v[0];
-    case 0xC: // RND Vx, byte
-        v[x] = random(0x0, 0xFF) & nn;
-        break;
-    case 0xD: // DRW Vx, Vy, nibble
-        v[0xF] = drawAlgorithm(v[x], v[y], nibble);
-        break;
-    case 0xE:
-        switch (code & 0x00FF)
+        recompiled->run(*this, end);
+    }
+    else
+    {
+        while (cycles < end && !endlessLoop) emulateCycle();
+    }
+    return cycles - begin;
+}
+
+CHIP8::idle_loop CHIP8::idleLoop() const
+{
+    idle_loop none = { idle_loop::NONE, pc, pc };
+    if (endlessLoop || pc > 0xFFA) return none;
+
+    instruction const& first = opcodes[fetch(pc)];
+    if (first.exec == ops::ldK) return lastKey < 0 ? idle_loop{ idle_loop::KEY, pc, pc } : none;
+    if (first.exec != ops::ldVxDT) return none;
+    instruction const& test = opcodes[fetch(pc + 2)];
+    instruction const& back = opcodes[fetch(pc + 4)];
+    if (test.exec == ops::seByte && test.x == first.x && back.exec == ops::jp && back.addr == pc && delayTimer != test.nn)
+        return { idle_loop::TIMER, pc, (dbyte)(pc + 4) };
+    return none;
+}
+
+unsigned long long CHIP8::skipIdle(unsigned long long count)
+{
+    idle_loop loop = idleLoop();
+    if (loop.what == idle_loop::NONE) return 0;
+    unsigned long long length = (loop.end - loop.start) / 2 + 1;
+    unsigned long long skipped = count / length * length;
+    if (skipped == 0) return 0;
+
+    if (journal && cycles >= journal->nextCheckpoint) journal->take(*this);
+    if (loops) loops->forget();
+    if (loop.what == idle_loop::TIMER) v[fetch(pc) >> 8 & 0xF] = delayTimer; // What every iteration does
+    cycles += skipped;
+    idleCycles += skipped;
+    return skipped;
+}
+
+void CHIP8::invalidate(dbyte addr)
+{
+    // An instruction starting one byte earlier also covers addr
+    for (int a : { addr & 0xFFF, (addr - 1) & 0xFFF })
+    {
+        if (decoded[a].exec)
         {
-        case 0x9E: // SKP Vx
-            if (keys[v[x]] == true)
-            {
-                pc += 2;
-                
-            }
-            break;
-        case 0xA1: // SKNP Vx
-            if (keys[v[x]] != true)
-            {
-                pc += 2;
-            }
-            break;
-        default:
-            errorInternal("Unknown opcode: " + type_to_hex(code));
-            break;
+            decoded[a].exec = nullptr;
+            invalidations++;
         }
-        break;
-    case 0xF:
-        switch (code & 0x00FF)
+    }
+    if (blocks && blocks->code[addr & 0xFFF]) invalidations += blocks->invalidate(addr & 0xFFF); // Most writes are data
+    if (jitted) invalidations += jitted->invalidate(addr & 0xFFF);
+    if (recompiled) invalidations += recompiled->invalidate(addr & 0xFFF);
+    if (loops) loops->write(addr, ram[addr & 0xFFF]);
+}
+
+void CHIP8::invalidateAll()
+{
+    for (instruction& ins : decoded) ins.exec = nullptr;
+    if (blocks) blocks->flush();
+    if (jitted) jitted->flush();
+    if (recompiled) recompiled->bind(*this);
+    if (loops) loops->reset(*this);
+}
+
+uint64_t CHIP8::displayHash() const
+{
+    if (hashedGeneration == displayGeneration) return lastHash;
+
+    // Pixels are hashed packed by 8, leftmost pixel in the high bit
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint64_t row : graphicsMap)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
         {
-        case 0x07: // LD Vx, DT
-            v[x] = delayTimer;
-            break;
-        case 0x0A: // LD Vx, K
-            if (lastKey >= 0)
-            {
-                v[x] = lastKey;
-                lastKey = -1;
-            }
-            else pc -= 2;
-            break;
-        case 0x15: // LD DT, Vx
-            delayTimer = v[x];
-            break;
-        case 0x18: // LD ST, Vx
-            soundTimer = v[x];
-            break;
-        case 0x1E: // ADD I, Vx
-            I = I + v[x];
-            break;
-        case 0x29: // LD F, Vx
-            I = v[x] * 5;
-            break;
-        case 0x33:
-            if (I >= 0xFFF) errorInternal("Segmentation fault: I >= 0xFFF");
-            ram[I] = (v[x] / 100) % 10;
-            ram[I + 1] = (v[x] / 10) % 10;
-            ram[I + 2] = v[x] % 10;
-            break;
-        case 0x55:
-            if (I >= 0xFFF && x != 0) errorInternal("Segmentation fault: I >= 0xFFF");
-            for (int i = 0; i <= x; i++)
-            {
-                ram[I + i] = v[i];
-            }
-            break;
-        case 0x65:
-            if (I >= 0xFFF && x != 0) errorInternal("Segmentation fault: I >= 0xFFF");
-            for (int i = 0; i <= x; i++)
-            {
-                v[i] = ram[I + i];
-            }
-            break;
-        default:
-            errorInternal("Unknown opcode: " + type_to_hex(code));
-            break;
+            hash ^= (row >> shift) & 0xFF;
+            hash *= 0x100000001b3ULL;
         }
-        break;
-    default:
-        errorInternal("Unknown opcode: " + type_to_hex(code));
-        break;
     }
+    hashedGeneration = displayGeneration;
+    lastHash = hash;
+    return hash;
 }
 
 string CHIP8::regInfo() const
@@ -540,13 +461,11 @@ string CHIP8::regInfo() const
 
 void CHIP8::errorInternal(string const& text)
 {
-    logger::error("ERROR: " + text);
     if (logCallback) logCallback("ERROR: " + text);
     endlessLoop = true;
 }
 
 void CHIP8::infoInternal(string const& text)
 {
-    logger::info("INFO: " + text);
     if (logCallback) logCallback("INFO: " + text);
 }
\ No newline at end of file
@@ -28,31 +28,131 @@ SOFTWARE.
 
 #include <cstdint>
 #include <array>
-#include <fstream>
 #include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
 
-class CHIP8
+#include "rng.hpp"
+
+// Architectural state of a machine, kept apart from the caches and the callbacks so that
+// a snapshot is a single copy. The registers are accessed as members of CHIP8
+struct CHIP8State
+{
+	std::array<unsigned char, 4096> ram;
+	std::array<uint64_t, 32> graphicsMap; // Pixel x of a row is bit 63 - x
+	std::array<uint16_t, 16> stack;
+	std::array<unsigned char, 16> v;
+	std::array<bool, 16> keys;
+	uint16_t I, pc;
+	unsigned char sp;
+	unsigned char soundTimer, delayTimer;
+	int lastKey;
+	pcg32 rng; // Reseeded by refresh(), so a restart replays the same numbers
+	unsigned long long cycles; // Executed instructions since refresh
+	bool endlessLoop;
+};
+
+class CHIP8 : private CHIP8State
 {
 public:
 	using byte = unsigned char;
 	using dbyte = uint16_t;
+	using state = CHIP8State;
+	static_assert(std::is_trivially_copyable<state>::value, "Snapshots are plain copies");
+
+	struct instruction;
+	using handler = void (*)(CHIP8&, instruction const&);
+
+	// Decoded opcode: handler plus operands extracted once
+	struct instruction
+	{
+		handler exec;
+		dbyte code;
+		dbyte addr; // nnn
+		byte x, y, n, nn;
+	};
+
+	enum class engine
+	{
+		interpreter, // Decode through the opcode table on every cycle
+		cached,      // Keep decoded instructions per RAM address
+		block,       // Run cached basic blocks with fused instruction pairs
+		jit,         // Compile hot blocks to x86-64, interpret the rest
+		aot          // Run code generated by chip8-recomp for this ROM, interpret the rest
+	};
+
+	struct aot; // Support for recompiled ROMs, see aot.hpp
+
+	struct code_range
+	{
+		dbyte start, end; // First and last instruction
+	};
+
+	// A loop that only waits: LD Vx, DT / SE Vx, nn / JP back to the LD (until DT is nn),
+	// or LD Vx, K with no key pressed
+	struct idle_loop
+	{
+		enum kind : byte { NONE, TIMER, KEY };
+
+		kind what;
+		dbyte start, end; // Its first and last instruction
+	};
+
+	// A change to the machine from outside, made before the instruction at cycle executes
+	struct input
+	{
+		enum kind : byte { KEY_DOWN, KEY_UP, CLEAR_LAST_KEY, TICK_TIMERS, SET_RAM, RESET_STOP };
+
+		unsigned long long cycle;
+		dbyte addr; // SET_RAM
+		kind what;
+		byte value; // Key or SET_RAM byte
+	};
 
 private:
-	std::string romPath;
-	std::ifstream romFile;
+	struct ops; // Instruction handlers, see ops.hpp
+	struct block_cache; // See blocks.hpp
+	struct jit_cache; // See jit.hpp
+	struct rewind_buffer; // See rewind.hpp
+	struct timeline; // See timeline.hpp
+	struct loop_detector; // See loops.hpp
 
-	std::array<std::array<bool, 64>, 32> graphicsMap;
-	std::array<byte, 4096> ram;
-	std::array<dbyte, 16> stack;
-	std::array<bool, 16> keys;
-
-	byte sp;
-	std::array<byte, 16> v;
-	dbyte I, pc, code;
-	
-	bool endlessLoop;
 
+	std::string romPath;
+	uint64_t romHash = 0;
+	uint64_t seed = 0;
+
+	instruction const* opcodes = decodeTable();
+	static instruction const* decodeTable(); // 0x10000 entries, indexed by opcode
+
+	engine currentEngine = engine::interpreter;
+	std::array<instruction, 4096> decoded{}; // exec == nullptr means not decoded yet
+	unsigned long long invalidations = 0;
+	unsigned long long idleCycles = 0;
+	std::unique_ptr<block_cache> blocks; // Allocated on first use of engine::block
+	std::unique_ptr<jit_cache> jitted; // Allocated on first use of engine::jit
+	std::unique_ptr<aot> recompiled; // Allocated on first use of engine::aot
+	std::unique_ptr<rewind_buffer> history; // Allocated by the first recordFrame()
+	std::unique_ptr<timeline> journal; // Allocated by setCheckpointInterval()
+	std::unique_ptr<loop_detector> loops; // Allocated by setLoopDetection()
+
+	// Display changes, kept outside the state: restoring one marks the rows that differ
+	uint32_t dirtyRows = 0; // Bit y is row y, cleared by takeDirtyRows()
+	unsigned long long displayGeneration = 0;
+	unsigned long long frameGeneration = 0; // displayGeneration at the last endFrame()
+	mutable unsigned long long hashedGeneration = ~0ULL;
+	mutable uint64_t lastHash = 0;
+
+	void invalidate(dbyte addr); // Must be called on every RAM write
+	void invalidateAll();
+
+	dbyte fetch(dbyte addr) const { return ram[addr & 0xFFF] << 8 | ram[(addr + 1) & 0xFFF]; }
 	bool drawAlgorithm(byte vx, byte vy, byte n);
+	void clearDisplay();
+	void markRows(uint32_t rows) { if (rows) { dirtyRows |= rows; displayGeneration++; } }
+	void restore(state const& in);
+	void apply(input const& in);
 
 	// Used for logging
 	void errorInternal(std::string const& text);
@@ -66,24 +166,70 @@ public:
 	bool reload(std::string newPath);
 	void refresh();
 	void emulateCycle();
-
-	void setKey(int key) { keys[key] = true; lastKey = key; }
-	void unsetKey(int key) { keys[key] = false; }
-	void setRam(dbyte addr, byte value) { ram[addr] = value; }
-	void resetEndlessLoop() { endlessLoop = false; }
-
-	byte soundTimer, delayTimer; // Exception
-	int lastKey;
+	unsigned long long run(unsigned long long count); // Returns executed instructions
+
+	// Idle loops only end on an input (a timer tick or a key), so up to the next one the
+	// machine can skip whole iterations: the state is the same as if it ran them
+	idle_loop idleLoop() const; // The loop pc is at the start of and that would keep waiting, or NONE
+	unsigned long long skipIdle(unsigned long long count); // Skips at most count cycles, returns the cycles skipped
+
+	// Input from outside the machine: journaled for reverse debugging and passed to inputCallback
+	void send(input const& in); // in.cycle is ignored, it's the current cycle
+	void setKey(int key) { send({ 0, 0, input::KEY_DOWN, (byte)key }); }
+	void unsetKey(int key) { send({ 0, 0, input::KEY_UP, (byte)key }); }
+	void clearLastKey() { if (lastKey >= 0) send({ 0, 0, input::CLEAR_LAST_KEY, 0 }); } // Fx0A only sees a key for one instruction
+	void tickTimers() { if (delayTimer || soundTimer) send({ 0, 0, input::TICK_TIMERS, 0 }); } // 60 Hz
+	void setRam(dbyte addr, byte value) { send({ 0, addr, input::SET_RAM, value }); }
+	void resetEndlessLoop() { send({ 0, 0, input::RESET_STOP, 0 }); }
+
+	void setEngine(engine e) { currentEngine = e; }
+	void saveState(state& out) const { out = *this; }
+	void loadState(state const& in); // Decoded code is dropped only where RAM differs
+	void recordFrame(); // Snapshot for rewind(), once per frame
+	int rewind(int frames); // Back to the snapshot recorded frames ago, returns frames actually rewound
+
+	// Reverse debugging: inputs are journaled and the state is saved every interval cycles
+	// (0 turns it off). Going back restores the checkpoint before the target and
+	// interprets forward, so interval bounds the cost of a step back
+	void setCheckpointInterval(unsigned long long interval);
+	bool stepBack(unsigned long long count); // False if the cycle isn't recorded
+	bool reverseContinue(dbyte breakpoint); // Back to the last time pc was breakpoint, false if it never was
+	void setSeed(uint64_t newSeed) { seed = newSeed; rng.seed(seed); }
+
+	// Off by default: catches any loop that comes back to the same state without reading the keys or
+	// setting a timer, not only a jump to itself, at the cost of hashing the state in every run()
+	void setLoopDetection(bool on);
+	code_range loopRange() const; // The addresses of the loop caughtEndlessLoop() is about
+
+	using state::soundTimer; // Exception
+	using state::delayTimer;
+	using state::lastKey;
 	std::function<void(std::string const&)> logCallback;
+	std::function<void(input const&)> inputCallback; // Used to record input movies
+	std::function<void()> frameCallback; // Called by endFrame() when the frame changed the display
 
-	bool display(int x, int y) const { return graphicsMap[y][x]; }
+	bool display(int x, int y) const { return graphicsMap[y] >> (63 - x) & 1; }
+	uint64_t displayRow(int y) const { return graphicsMap[y]; } // Leftmost pixel in the high bit
 	bool caughtEndlessLoop() const { return endlessLoop; }
 	std::string regInfo() const;
 	dbyte getPC() const { return pc; }
 	dbyte getI() const { return I; }
 	byte getFromRam(dbyte addr) const { return ram[addr]; }
-
-	static std::string disasmCode(int code);
+	unsigned long long getCycles() const { return cycles; }
+	uint64_t getSeed() const { return seed; }
+	uint64_t getRomHash() const { return romHash; } // FNV-1a over the ROM file, see aot::hash
+	engine getEngine() const { return currentEngine; }
+	unsigned long long getInvalidations() const { return invalidations; } // Decoded code that was overwritten
+	unsigned long long getIdleCycles() const { return idleCycles; } // Skipped by skipIdle()
+	uint64_t displayHash() const; // FNV-1a over the display, used by headless runs. Recomputed only after a change
+
+	// Display changes for renderers: the generation grows with every change of a pixel, the rows
+	// changed since the last takeDirtyRows() are a bit mask (bit y is row y)
+	unsigned long long getDisplayGeneration() const { return displayGeneration; }
+	uint32_t takeDirtyRows() { uint32_t rows = dirtyRows; dirtyRows = 0; return rows; }
+	void endFrame(); // Once per host frame, after its instructions
+
+	static std::string disasmCode(int code); // See isa.hpp
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,496 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "CHIP8Batch.hpp"
+#include "../common.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+extern unsigned char chip8_fontset[80]; // CHIP8.cpp
+
+namespace
+{
+	constexpr int VECTOR_LANES = 32; // Bytes in an AVX2 register
+
+	// dst[i] = op(a[i], b[i]) where mask[i] is set, 32 lanes per iteration with AVX2.
+	// LANES1 is for ops of one operand, LANES0 for a constant
+#ifdef __AVX2__
+	template <class Op>
+	void apply(unsigned char* dst, unsigned char const* a, unsigned char const* b, unsigned char const* mask, int width, Op op)
+	{
+		for (int i = 0; i < width; i += VECTOR_LANES)
+		{
+			__m256i x = _mm256_loadu_si256((__m256i const*)(a + i));
+			__m256i y = _mm256_loadu_si256((__m256i const*)(b + i));
+			__m256i m = _mm256_loadu_si256((__m256i const*)(mask + i));
+			__m256i d = _mm256_loadu_si256((__m256i const*)(dst + i));
+			_mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(d, op(x, y), m));
+		}
+	}
+#define LANES(dst, a, b, vectorOp, scalarOp) apply(dst, a, b, mask, width, [&](__m256i x, __m256i y) { return vectorOp; })
+#define LANES1(dst, a, vectorOp, scalarOp) apply(dst, a, a, mask, width, [&](__m256i x, __m256i) { return vectorOp; })
+#define LANES0(dst, vectorOp, scalarOp) apply(dst, dst, dst, mask, width, [&](__m256i, __m256i) { return vectorOp; })
+#else
+	template <class Op>
+	void apply(unsigned char* dst, unsigned char const* a, unsigned char const* b, unsigned char const* mask, int width, Op op)
+	{
+		for (int i = 0; i < width; i++)
+			if (mask[i]) dst[i] = op(a[i], b[i]);
+	}
+#define LANES(dst, a, b, vectorOp, scalarOp) apply(dst, a, b, mask, width, [&](unsigned char x, unsigned char y) { return (unsigned char)(scalarOp); })
+#define LANES1(dst, a, vectorOp, scalarOp) apply(dst, a, a, mask, width, [&](unsigned char x, unsigned char) { return (unsigned char)(scalarOp); })
+#define LANES0(dst, vectorOp, scalarOp) apply(dst, dst, dst, mask, width, [&](unsigned char, unsigned char) { return (unsigned char)(scalarOp); })
+#endif
+}
+
+CHIP8Batch::CHIP8Batch(int lanes) : lanes(lanes), width((lanes + VECTOR_LANES - 1) / VECTOR_LANES * VECTOR_LANES)
+{
+	ram.assign(4096 * width, 0);
+	for (int i = 0; i < 80; i++)
+		fill(ram.begin() + i * width, ram.begin() + (i + 1) * width, chip8_fontset[i]);
+	graphicsMap.resize(32 * width);
+	for (auto& r : v) r.resize(width);
+	for (auto& s : stack) s.resize(width);
+	I.resize(width);
+	pc.resize(width);
+	sp.resize(width);
+	delayTimers.resize(width);
+	soundTimers.resize(width);
+	keys.resize(width);
+	lastKeys.resize(width);
+	rngs.resize(width);
+	seeds.assign(width, 0);
+	running.resize(width);
+	stoppedAt.resize(width);
+	groupMask.resize(width);
+	cond.resize(width);
+	refresh();
+}
+
+bool CHIP8Batch::reload(string const& path)
+{
+	ifstream romFile(path, ios::in | ios::binary);
+	if (!romFile)
+	{
+		refresh();
+		return false;
+	}
+	return load(vector<byte>((istreambuf_iterator<char>(romFile)), istreambuf_iterator<char>()));
+}
+
+bool CHIP8Batch::load(vector<byte> const& rom)
+{
+	refresh();
+	if (rom.size() > 3584) return false;
+
+	for (size_t i = 0; i < rom.size(); i++)
+		fill(ram.begin() + (0x200 + i) * width, ram.begin() + (0x200 + i + 1) * width, rom[i]);
+	return true;
+}
+
+void CHIP8Batch::refresh()
+{
+	fill(graphicsMap.begin(), graphicsMap.end(), 0);
+	for (auto& r : v) fill(r.begin(), r.end(), 0);
+	for (auto& s : stack) fill(s.begin(), s.end(), 0);
+	fill(I.begin(), I.end(), 0);
+	fill(pc.begin(), pc.end(), 0x200);
+	fill(sp.begin(), sp.end(), 0);
+	fill(delayTimers.begin(), delayTimers.end(), 0);
+	fill(soundTimers.begin(), soundTimers.end(), 0);
+	fill(keys.begin(), keys.end(), 0);
+	fill(lastKeys.begin(), lastKeys.end(), -1);
+	for (int lane = 0; lane < width; lane++) rngs[lane].seed(seeds[lane]);
+	fill(running.begin(), running.begin() + lanes, 0xFF);
+	fill(running.begin() + lanes, running.end(), 0);
+	fill(stoppedAt.begin(), stoppedAt.end(), 0);
+	runningLanes = lanes;
+	cycles = 0;
+	stats = statistics();
+}
+
+CHIP8Batch::dbyte CHIP8Batch::fetch(int lane, dbyte addr) const
+{
+	return ram[(addr & 0xFFF) * width + lane] << 8 | ram[((addr + 1) & 0xFFF) * width + lane];
+}
+
+void CHIP8Batch::stop(int lane, string const& text)
+{
+	if (logCallback) logCallback(lane, text);
+	if (!running[lane]) return;
+	running[lane] = 0;
+	stoppedAt[lane] = cycles;
+	runningLanes--;
+}
+
+int CHIP8Batch::coherent() const
+{
+	int first = int(find(running.begin(), running.end(), 0xFF) - running.begin());
+	if (first == width) return -1;
+
+	// Branchless over all lanes, so it vectorizes
+	dbyte addr = pc[first];
+	byte const* high = &ram[(addr & 0xFFF) * width];
+	byte const* low = &ram[((addr + 1) & 0xFFF) * width];
+	unsigned diff = 0;
+	for (int lane = 0; lane < width; lane++)
+		diff |= ((pc[lane] ^ addr) | (high[lane] ^ high[first]) | (low[lane] ^ low[first])) & (running[lane] * 0x101u);
+	return diff == 0 ? first : -1;
+}
+
+bool CHIP8Batch::step()
+{
+	if (runningLanes == 0) return false;
+	stats.steps++;
+	cycles++;
+
+	int first = coherent();
+	if (first >= 0)
+	{
+		stats.coherentSteps++;
+		if (runningLanes >= VECTOR_LANES && executeGroup(fetch(first, pc[first]), running.data()))
+		{
+			stats.groups++;
+			stats.vectorLanes += runningLanes;
+			return true;
+		}
+	}
+
+	// Address, opcode and lane packed in one key, so sorting groups lanes by instruction
+	order.clear();
+	for (int lane = 0; lane < lanes; lane++)
+		if (running[lane]) order.push_back((uint64_t)pc[lane] << 48 | (uint64_t)fetch(lane, pc[lane]) << 32 | lane);
+	if (first < 0) sort(order.begin(), order.end());
+
+	for (size_t begin = 0, end; begin < order.size(); begin = end)
+	{
+		end = begin + 1;
+		while (end < order.size() && order[end] >> 32 == order[begin] >> 32) end++;
+		dbyte code = (order[begin] >> 32) & 0xFFFF;
+		size_t n = end - begin;
+		stats.groups++;
+
+		if (n >= VECTOR_LANES)
+		{
+			fill(groupMask.begin(), groupMask.end(), 0);
+			for (size_t i = begin; i < end; i++) groupMask[order[i] & 0xFFFFFFFF] = 0xFF;
+			if (executeGroup(code, groupMask.data()))
+			{
+				stats.vectorLanes += n;
+				continue;
+			}
+		}
+		for (size_t i = begin; i < end; i++) executeLane(order[i] & 0xFFFFFFFF, code);
+		stats.scalarLanes += n;
+	}
+	return true;
+}
+
+void CHIP8Batch::run(unsigned long long count)
+{
+	for (unsigned long long i = 0; i < count && step(); i++);
+}
+
+void CHIP8Batch::tickTimers()
+{
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		if (delayTimers[lane] > 0) delayTimers[lane]--;
+		if (soundTimers[lane] > 0) soundTimers[lane]--;
+	}
+}
+
+uint64_t CHIP8Batch::displayHash(int lane) const
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (int y = 0; y < 32; y++)
+	{
+		uint64_t row = displayRow(lane, y);
+		for (int shift = 56; shift >= 0; shift -= 8)
+		{
+			hash ^= (row >> shift) & 0xFF;
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
+
+// Register, timer, I and branch instructions for the lanes in mask. Same semantics
+// as ops.hpp, including the order VF is written in
+bool CHIP8Batch::executeGroup(dbyte code, byte const* mask)
+{
+	int x = (code >> 8) & 0x0F, y = (code >> 4) & 0x0F;
+	byte nn = code & 0x00FF;
+	dbyte addr = code & 0x0FFF;
+	byte* vx = v[x].data();
+	byte* vy = v[y].data();
+	byte* vf = v[0xF].data();
+#ifdef __AVX2__
+	__m256i const one = _mm256_set1_epi8(1), ones = _mm256_set1_epi8(-1), imm = _mm256_set1_epi8((char)nn);
+#endif
+
+	bool skip = false;
+	switch (code >> 12)
+	{
+	case 0x1: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7: case 0x9: case 0xA:
+		break;
+	case 0x8:
+		if ((code & 0x000F) > 0x7 && (code & 0x000F) != 0xE) return false;
+		break;
+	case 0xF:
+		if (nn != 0x07 && nn != 0x15 && nn != 0x18 && nn != 0x1E && nn != 0x29) return false;
+		break;
+	default:
+		return false;
+	}
+
+	// Branchless, so it vectorizes
+	for (int lane = 0; lane < width; lane++) pc[lane] += mask[lane] & 2;
+
+	switch (code >> 12)
+	{
+	case 0x1: // JP addr
+		for (int lane = 0; lane < width; lane++)
+		{
+			if (!mask[lane]) continue;
+			pc[lane] = addr;
+			if (fetch(lane, addr) == code) stop(lane, "INFO: Caught endless loop");
+		}
+		break;
+	case 0x3: // SE Vx, byte
+		LANES1(cond.data(), vx, _mm256_cmpeq_epi8(x, imm), x == nn ? 0xFF : 0);
+		skip = true;
+		break;
+	case 0x4: // SNE Vx, byte
+		LANES1(cond.data(), vx, _mm256_andnot_si256(_mm256_cmpeq_epi8(x, imm), ones), x != nn ? 0xFF : 0);
+		skip = true;
+		break;
+	case 0x5: // SE Vx, Vy
+		LANES(cond.data(), vx, vy, _mm256_cmpeq_epi8(x, y), x == y ? 0xFF : 0);
+		skip = true;
+		break;
+	case 0x9: // SNE Vx, Vy
+		LANES(cond.data(), vx, vy, _mm256_andnot_si256(_mm256_cmpeq_epi8(x, y), ones), x != y ? 0xFF : 0);
+		skip = true;
+		break;
+	case 0x6: // LD Vx, byte
+		LANES0(vx, imm, nn);
+		break;
+	case 0x7: // ADD Vx, byte
+		LANES1(vx, vx, _mm256_add_epi8(x, imm), x + nn);
+		break;
+	case 0x8:
+		switch (code & 0x000F)
+		{
+		case 0x0: LANES1(vx, vy, x, x); break;
+		case 0x1: LANES(vx, vx, vy, _mm256_or_si256(x, y), x | y); break;
+		case 0x2: LANES(vx, vx, vy, _mm256_and_si256(x, y), x & y); break;
+		case 0x3: LANES(vx, vx, vy, _mm256_xor_si256(x, y), x ^ y); break;
+		case 0x4: // Carry when the byte sum wrapped below x
+			LANES(vf, vx, vy, _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_add_epi8(x, y), x), x), one), x + y > 0xFF);
+			LANES(vx, vx, vy, _mm256_add_epi8(x, y), x + y);
+			break;
+		case 0x5: // x > y unless max(x, y) == y
+			LANES(vf, vx, vy, _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, y), y), one), x > y);
+			LANES(vx, vx, vy, _mm256_sub_epi8(x, y), x - y);
+			break;
+		case 0x6:
+			LANES1(vf, vx, _mm256_and_si256(x, one), x & 1);
+			LANES1(vx, vx, _mm256_and_si256(_mm256_srli_epi16(x, 1), _mm256_set1_epi8(0x7F)), x >> 1);
+			break;
+		case 0x7:
+			LANES(vf, vy, vx, _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, y), y), one), x > y);
+			LANES(vx, vy, vx, _mm256_sub_epi8(x, y), x - y);
+			break;
+		case 0xE:
+			LANES1(vf, vx, _mm256_and_si256(_mm256_srli_epi16(x, 7), one), x >> 7);
+			LANES1(vx, vx, _mm256_add_epi8(x, x), x << 1);
+			break;
+		}
+		break;
+	case 0xA: // LD I, addr
+		for (int lane = 0; lane < width; lane++)
+			if (mask[lane]) I[lane] = addr;
+		break;
+	case 0xF:
+		switch (nn)
+		{
+		case 0x07: LANES1(vx, delayTimers.data(), x, x); break;
+		case 0x15: LANES1(delayTimers.data(), vx, x, x); break;
+		case 0x18: LANES1(soundTimers.data(), vx, x, x); break;
+		case 0x1E:
+			for (int lane = 0; lane < width; lane++)
+				if (mask[lane]) I[lane] += vx[lane];
+			break;
+		case 0x29:
+			for (int lane = 0; lane < width; lane++)
+				if (mask[lane]) I[lane] = vx[lane] * 5;
+			break;
+		}
+		break;
+	}
+
+	if (skip)
+	{
+		for (int lane = 0; lane < width; lane++) pc[lane] += mask[lane] & cond[lane] & 2;
+	}
+	return true;
+}
+
+// Any instruction for one lane, same semantics as ops.hpp
+void CHIP8Batch::executeLane(int lane, dbyte code)
+{
+	pc[lane] += 2;
+
+	int x = (code >> 8) & 0x0F, y = (code >> 4) & 0x0F, n = code & 0x000F;
+	byte nn = code & 0x00FF;
+	dbyte addr = code & 0x0FFF;
+	byte& vx = v[x][lane];
+	byte& vy = v[y][lane];
+	byte& vf = v[0xF][lane];
+
+	switch (code >> 12)
+	{
+	case 0x0:
+		if (code == 0x00E0)
+		{
+			for (int row = 0; row < 32; row++) graphicsMap[row * width + lane] = 0;
+			return;
+		}
+		if (code == 0x00EE)
+		{
+			if (sp[lane] == 0)
+			{
+				stop(lane, "ERROR: Stack underflow");
+				return;
+			}
+			pc[lane] = stack[sp[lane]][lane];
+			sp[lane]--;
+			return;
+		}
+		break;
+	case 0x1:
+		pc[lane] = addr;
+		if (fetch(lane, addr) == code) stop(lane, "INFO: Caught endless loop");
+		return;
+	case 0x2:
+		if (sp[lane] + 1 >= 16)
+		{
+			stop(lane, "ERROR: Stack overflow");
+			return;
+		}
+		sp[lane]++;
+		stack[sp[lane]][lane] = pc[lane];
+		pc[lane] = addr;
+		if (fetch(lane, addr) == code) stop(lane, "INFO: Caught endless loop");
+		return;
+	case 0x3: if (vx == nn) pc[lane] += 2; return;
+	case 0x4: if (vx != nn) pc[lane] += 2; return;
+	case 0x5: if (vx == vy) pc[lane] += 2; return;
+	case 0x6: vx = nn; return;
+	case 0x7: vx += nn; return;
+	case 0x8:
+		switch (n)
+		{
+		case 0x0: vx = vy; return;
+		case 0x1: vx = vx | vy; return;
+		case 0x2: vx = vx & vy; return;
+		case 0x3: vx = vx ^ vy; return;
+		case 0x4: vf = (vx + vy) > 0xFF; vx += vy; return;
+		case 0x5: vf = vx > vy; vx -= vy; return;
+		case 0x6: vf = vx & 0b00000001; vx = vx >> 1; return;
+		case 0x7: vf = vy > vx; vx = vy - vx; return;
+		case 0xE: vf = (vx & 0b10000000) != 0; vx <<= 1; return;
+		}
+		break;
+	case 0x9: if (vx != vy) pc[lane] += 2; return;
+	case 0xA: I[lane] = addr; return;
+	case 0xB: pc[lane] = addr + v[0][lane]; return;
+	case 0xC: vx = rngs[lane].next() & nn; return;
+	case 0xD:
+	{
+		byte px = vx, py = vy;
+		if (I[lane] + n > 0xFFF)
+		{
+			stop(lane, "ERROR: Segmentation fault: I + n > 0xFFF");
+			vf = false;
+			return;
+		}
+		bool collision = false;
+		int shift = px % 64;
+		for (int i = 0; i < n; i++)
+		{
+			uint64_t sprite = (uint64_t)at(lane, I[lane] + i) << 56;
+			if (shift) sprite = sprite >> shift | sprite << (64 - shift);
+			uint64_t& row = graphicsMap[((py + i) % 32) * width + lane];
+			collision |= (row & sprite) != 0;
+			row ^= sprite;
+		}
+		vf = collision;
+		return;
+	}
+	case 0xE:
+		if (nn == 0x9E) { if (keys[lane] >> (vx & 0xF) & 1) pc[lane] += 2; return; }
+		if (nn == 0xA1) { if (!(keys[lane] >> (vx & 0xF) & 1)) pc[lane] += 2; return; }
+		break;
+	case 0xF:
+		switch (nn)
+		{
+		case 0x07: vx = delayTimers[lane]; return;
+		case 0x0A:
+			if (lastKeys[lane] >= 0)
+			{
+				vx = lastKeys[lane];
+				lastKeys[lane] = -1;
+			}
+			else pc[lane] -= 2;
+			return;
+		case 0x15: delayTimers[lane] = vx; return;
+		case 0x18: soundTimers[lane] = vx; return;
+		case 0x1E: I[lane] = I[lane] + vx; return;
+		case 0x29: I[lane] = vx * 5; return;
+		case 0x33:
+			if (I[lane] >= 0xFFF) stop(lane, "ERROR: Segmentation fault: I >= 0xFFF");
+			at(lane, I[lane]) = (vx / 100) % 10;
+			at(lane, I[lane] + 1) = (vx / 10) % 10;
+			at(lane, I[lane] + 2) = vx % 10;
+			return;
+		case 0x55:
+			if (I[lane] >= 0xFFF && x != 0) stop(lane, "ERROR: Segmentation fault: I >= 0xFFF");
+			for (int i = 0; i <= x; i++) at(lane, I[lane] + i) = v[i][lane];
+			return;
+		case 0x65:
+			if (I[lane] >= 0xFFF && x != 0) stop(lane, "ERROR: Segmentation fault: I >= 0xFFF");
+			for (int i = 0; i <= x; i++) v[i][lane] = at(lane, I[lane] + i);
+			return;
+		}
+		break;
+	}
+	stop(lane, "ERROR: Unknown opcode: " + type_to_hex(code));
+}
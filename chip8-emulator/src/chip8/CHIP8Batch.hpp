@@ -0,0 +1,113 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include "CHIP8.hpp"
+#include <vector>
+
+// Many machines running the same ROM, stored as structure of arrays: element
+// [i][lane] of each field is lane's copy. Lanes that are at the same address with the
+// same opcode execute together, register arithmetic 32 lanes at a time with AVX2
+// (when the compiler targets it), the rest lane by lane
+class CHIP8Batch
+{
+public:
+	using byte = CHIP8::byte;
+	using dbyte = CHIP8::dbyte;
+
+	struct statistics
+	{
+		unsigned long long steps = 0; // With at least one lane running
+		unsigned long long coherentSteps = 0; // Every running lane had the same instruction
+		unsigned long long groups = 0; // Sets of lanes sharing an instruction, over all steps
+		unsigned long long vectorLanes = 0; // Lane instructions executed by the vector path
+		unsigned long long scalarLanes = 0;
+	};
+
+private:
+	int lanes;
+	int width; // lanes rounded up to a vector
+
+	std::vector<byte> ram; // [addr * width + lane]
+	std::vector<uint64_t> graphicsMap; // [row * width + lane], pixel x is bit 63 - x
+	std::array<std::vector<byte>, 16> v;
+	std::array<std::vector<dbyte>, 16> stack;
+	std::vector<dbyte> I, pc;
+	std::vector<byte> sp, delayTimers, soundTimers;
+	std::vector<uint16_t> keys; // Bit per key
+	std::vector<int> lastKeys;
+	std::vector<pcg32> rngs;
+	std::vector<uint64_t> seeds; // Same as a CHIP8 by default, so lanes stay together through rnd
+	std::vector<byte> running; // 0xFF while the lane runs, the mask of coherent steps
+	int runningLanes;
+	unsigned long long cycles; // Every running lane executes one instruction per step
+	std::vector<unsigned long long> stoppedAt; // Cycles of stopped lanes
+
+	statistics stats;
+
+	// Scratch for step()
+	std::vector<byte> groupMask, cond;
+	std::vector<uint64_t> order;
+
+	dbyte fetch(int lane, dbyte addr) const;
+	byte& at(int lane, int addr) { return ram[(addr & 0xFFF) * width + lane]; }
+	void executeLane(int lane, dbyte code);
+	bool executeGroup(dbyte code, byte const* mask); // False if code has no vector form
+	int coherent() const; // First running lane if all are at the same address with the same opcode, else -1
+	void stop(int lane, std::string const& text);
+
+public:
+	explicit CHIP8Batch(int lanes);
+
+	bool reload(std::string const& path); // Same ROM in every lane
+	bool load(std::vector<byte> const& rom); // Same, from memory
+	void refresh();
+	bool step(); // One instruction on every running lane, false if none runs
+	void run(unsigned long long count);
+	void tickTimers(); // 60 Hz
+
+	void setKey(int lane, int key) { keys[lane] |= 1 << key; lastKeys[lane] = key; }
+	void unsetKey(int lane, int key) { keys[lane] &= ~(1 << key); }
+	void setSeed(int lane, uint64_t seed) { seeds[lane] = seed; rngs[lane].seed(seed); }
+
+	std::function<void(int, std::string const&)> logCallback; // Lane and message
+
+	int size() const { return lanes; }
+	bool display(int lane, int x, int y) const { return displayRow(lane, y) >> (63 - x) & 1; }
+	uint64_t displayRow(int lane, int y) const { return graphicsMap[y * width + lane]; }
+	uint64_t displayHash(int lane) const; // Same as CHIP8::displayHash
+	bool stopped(int lane) const { return !running[lane]; }
+	dbyte getPC(int lane) const { return pc[lane]; }
+	dbyte getI(int lane) const { return I[lane]; }
+	byte getV(int lane, int i) const { return v[i][lane]; }
+	byte getFromRam(int lane, dbyte addr) const { return ram[(addr & 0xFFF) * width + lane]; }
+	uint64_t getSeed(int lane) const { return seeds[lane]; }
+	unsigned long long getCycles(int lane) const { return running[lane] ? cycles : stoppedAt[lane]; }
+	statistics const& getStatistics() const { return stats; }
+};
+
+#endif
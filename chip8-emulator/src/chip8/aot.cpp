@@ -0,0 +1,106 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "aot.hpp"
+
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	vector<CHIP8::aot::program>& programs()
+	{
+		static vector<CHIP8::aot::program> res;
+		return res;
+	}
+}
+
+bool CHIP8::aot::add(program const& p)
+{
+	programs().push_back(p);
+	return true;
+}
+
+uint64_t CHIP8::aot::hash(byte const* data, size_t size)
+{
+	uint64_t res = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++)
+	{
+		res ^= data[i];
+		res *= 0x100000001b3ULL;
+	}
+	return res;
+}
+
+void CHIP8::aot::bind(CHIP8& c)
+{
+	table.fill(entry{});
+	for (program const& p : programs())
+	{
+		if (p.size > c.ram.size() - 0x200 || hash(c.ram.data() + 0x200, p.size) != p.hash) continue;
+		for (size_t i = 0; i < p.count; i++) table[p.entries[i].addr] = p.entries[i];
+		return;
+	}
+	c.infoInternal("No recompiled code for this ROM, interpreting");
+}
+
+// Blocks only cover what chip8-recomp found from 0x200, everything else
+// (Bnnn targets, code in RAM written at runtime, overwritten blocks) is interpreted
+void CHIP8::aot::run(CHIP8& c, unsigned long long end)
+{
+	unsigned long long left = end - c.cycles;
+	while (left > 0 && !c.endlessLoop)
+	{
+		if (c.pc <= 0xFFF)
+		{
+			entry const& e = table[c.pc];
+			if (e.run && e.length <= left)
+			{
+				int executed = e.run(c);
+				c.cycles += executed;
+				left -= executed;
+				continue;
+			}
+		}
+		c.emulateCycle();
+		left--;
+	}
+}
+
+int CHIP8::aot::invalidate(dbyte addr)
+{
+	int dropped = 0;
+	for (int start = max(0, addr - 2 * MAX_BLOCK + 1); start <= addr; start++)
+	{
+		entry& e = table[start];
+		if (e.run && addr < start + e.bytes)
+		{
+			e.run = nullptr;
+			dropped++;
+		}
+	}
+	return dropped;
+}
@@ -0,0 +1,79 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Support for code generated by chip8-recomp. Generated translation units
+// include this header, so unlike ops.hpp it is part of the core's interface
+
+#ifndef CHIP8_AOT_H
+#define CHIP8_AOT_H
+
+#include "CHIP8.hpp"
+#include "ops.hpp"
+
+struct CHIP8::aot : CHIP8::ops
+{
+	using block = int (*)(CHIP8&); // Returns executed instructions
+
+	struct entry
+	{
+		dbyte addr;
+		byte length; // Instructions
+		byte bytes;
+		block run;
+	};
+
+	struct program
+	{
+		uint64_t hash; // See hash(), over the ROM file
+		size_t size;
+		entry const* entries;
+		size_t count;
+	};
+
+	static constexpr int MAX_BLOCK = 32;
+
+	static bool add(program const& p); // Generated code calls it during static initialization
+	static uint64_t hash(byte const* data, size_t size); // FNV-1a
+
+	// Generated blocks are sequences of these, the host compiler sees every handler with
+	// constant operands
+	template <dbyte code, dbyte addr>
+	static void step(CHIP8& c)
+	{
+		static constexpr instruction ins = decode(code);
+		c.pc = addr + 2;
+		ins.exec(c, ins);
+	}
+	static bool stopped(CHIP8 const& c) { return c.endlessLoop; }
+
+	void bind(CHIP8& c); // Looks up the program for the loaded ROM
+	void run(CHIP8& c, unsigned long long end);
+	int invalidate(dbyte addr); // Returns the number of blocks dropped
+
+private:
+	std::array<entry, 4096> table{}; // run == nullptr means interpreted
+};
+
+#endif
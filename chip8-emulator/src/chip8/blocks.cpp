@@ -0,0 +1,291 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "blocks.hpp"
+#include "ops.hpp"
+
+using namespace std;
+
+CHIP8::block_cache::kind CHIP8::block_cache::classify(handler h)
+{
+	using o = CHIP8::ops;
+	static const pair<handler, kind> kinds[] =
+	{
+		{ o::cls, CLS }, { o::ret, RET }, { o::jp, JP }, { o::call, CALL },
+		{ o::seByte, SE_BYTE }, { o::sneByte, SNE_BYTE }, { o::seReg, SE_REG },
+		{ o::ldByte, LD_BYTE }, { o::addByte, ADD_BYTE }, { o::ldReg, LD_REG },
+		{ o::orReg, OR_REG }, { o::andReg, AND_REG }, { o::xorReg, XOR_REG },
+		{ o::addReg, ADD_REG }, { o::subReg, SUB_REG }, { o::shr, SHR },
+		{ o::subn, SUBN }, { o::shl, SHL }, { o::sneReg, SNE_REG }, { o::ldI, LD_I },
+		{ o::jpV0, JP_V0 }, { o::rnd, RND }, { o::drw, DRW }, { o::skp, SKP },
+		{ o::sknp, SKNP }, { o::ldVxDT, LD_VX_DT }, { o::ldK, LD_K }, { o::ldDT, LD_DT },
+		{ o::ldST, LD_ST }, { o::addI, ADD_I }, { o::ldF, LD_F }, { o::ldB, LD_B },
+		{ o::store, STORE }, { o::load, LOAD }
+	};
+	for (auto const& k : kinds)
+		if (k.first == h) return k.second;
+	return UNKNOWN;
+}
+
+bool CHIP8::block_cache::endsBlock(kind k)
+{
+	switch (k)
+	{
+	case JP: case CALL: case RET: case JP_V0: case LD_K: case UNKNOWN:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void CHIP8::block_cache::fuse(block& b)
+{
+	size_t n = b.ops.size();
+	for (size_t i = 0; i + 1 < n; i++)
+	{
+		kind first = b.ops[i].what;
+		kind second = b.ops[i + 1].what;
+		if (first == LD_BYTE && second == DRW)
+		{
+			b.ops[i].what = LD_DRW;
+			b.ops[i + 1].back = 1;
+			i++;
+		}
+		else if (first == LD_VX_DT && second == SE_BYTE)
+		{
+			b.ops[i].what = TIMER_SKIP;
+			b.ops[i + 1].back = 1;
+			i++;
+		}
+		else if (first == ADD_BYTE && second == SE_BYTE && i + 2 < n && b.ops[i + 2].what == JP)
+		{
+			b.ops[i].what = COUNT_LOOP;
+			b.ops[i + 1].back = 1;
+			b.ops[i + 2].back = 2;
+			i += 2;
+		}
+	}
+}
+
+void CHIP8::block_cache::build(CHIP8& c, block& b, dbyte start)
+{
+	b.ops.clear();
+	int addr = start;
+	while ((int)b.ops.size() < MAX_BLOCK && addr < 0xFFF)
+	{
+		instruction const& ins = c.opcodes[c.fetch(addr)];
+		kind k = classify(ins.exec);
+		b.ops.push_back({ ins, k, 0 });
+		addr += 2;
+		if (endsBlock(k)) break;
+	}
+	fuse(b);
+
+	b.length = (int)b.ops.size();
+	b.bytes = addr - start;
+	for (int i = start; i < addr; i++) code[i] = true;
+	b.valid = true;
+}
+
+// Runs ops until the end of the block or until the machine stops, returns executed instructions.
+// pc is advanced before each handler, same as emulateCycle does. A skip steps over the next op
+// and stays in the block, a RAM write leaves it if it overwrote decoded code. Only the ops
+// that can fail check for a stop
+int CHIP8::block_cache::execute(CHIP8& c, op const* o, op const* last)
+{
+	using h = CHIP8::ops;
+	int executed = 0;
+	dbyte pc = c.pc; // Only written back, so there's no dependency through memory between ops
+	unsigned long long invalidations = c.invalidations;
+	while (o != last)
+	{
+		instruction const& ins = o->ins;
+		pc += 2;
+		c.pc = pc;
+		switch (o->what)
+		{
+		case CLS: h::cls(c, ins); break;
+		case RET: h::ret(c, ins); return executed + 1;
+		case JP: h::jp(c, ins); return executed + 1;
+		case CALL: h::call(c, ins); return executed + 1;
+		case SE_BYTE: h::seByte(c, ins); break;
+		case SNE_BYTE: h::sneByte(c, ins); break;
+		case SE_REG: h::seReg(c, ins); break;
+		case LD_BYTE: h::ldByte(c, ins); break;
+		case ADD_BYTE: h::addByte(c, ins); break;
+		case LD_REG: h::ldReg(c, ins); break;
+		case OR_REG: h::orReg(c, ins); break;
+		case AND_REG: h::andReg(c, ins); break;
+		case XOR_REG: h::xorReg(c, ins); break;
+		case ADD_REG: h::addReg(c, ins); break;
+		case SUB_REG: h::subReg(c, ins); break;
+		case SHR: h::shr(c, ins); break;
+		case SUBN: h::subn(c, ins); break;
+		case SHL: h::shl(c, ins); break;
+		case SNE_REG: h::sneReg(c, ins); break;
+		case LD_I: h::ldI(c, ins); break;
+		case JP_V0: h::jpV0(c, ins); return executed + 1;
+		case RND: h::rnd(c, ins); break;
+		case DRW:
+			h::drw(c, ins);
+			if (c.endlessLoop) return executed + 1;
+			break;
+		case SKP: h::skp(c, ins); break;
+		case SKNP: h::sknp(c, ins); break;
+		case LD_VX_DT: h::ldVxDT(c, ins); break;
+		case LD_K: h::ldK(c, ins); return executed + 1;
+		case LD_DT: h::ldDT(c, ins); break;
+		case LD_ST: h::ldST(c, ins); break;
+		case ADD_I: h::addI(c, ins); break;
+		case LD_F: h::ldF(c, ins); break;
+		case LD_B:
+			h::ldB(c, ins);
+			if (c.invalidations != invalidations || c.endlessLoop) return executed + 1;
+			break;
+		case STORE:
+			h::store(c, ins);
+			if (c.invalidations != invalidations || c.endlessLoop) return executed + 1;
+			break;
+		case LOAD:
+			h::load(c, ins);
+			if (c.endlessLoop) return executed + 1;
+			break;
+		case UNKNOWN: h::unknown(c, ins); return executed + 1;
+
+		case LD_DRW:
+			h::ldByte(c, ins);
+			pc += 2;
+			c.pc = pc;
+			h::drw(c, o[1].ins);
+			if (c.endlessLoop) return executed + 2;
+			executed++;
+			o++;
+			break;
+		case TIMER_SKIP:
+			h::ldVxDT(c, ins);
+			pc += 2;
+			c.pc = pc;
+			h::seByte(c, o[1].ins);
+			executed++;
+			o++;
+			break;
+		case COUNT_LOOP:
+			h::addByte(c, ins);
+			pc += 2;
+			executed++;
+			if (c.v[o[1].ins.x] == o[1].ins.nn)
+			{
+				c.pc = pc + 2; // Skips the jump, which is the end of the block anyway
+				return executed + 1;
+			}
+			pc += 2;
+			c.pc = pc;
+			h::jp(c, o[2].ins);
+			return executed + 2;
+		}
+		executed++;
+		// Fused ops step over the instructions they cover themselves,
+		// so the pointer doesn't depend on a load
+		o++;
+		if (c.pc != pc)
+		{
+			// A skip: the next op isn't run, and the block ends if it was the last one
+			pc = c.pc;
+			if (o == last) break;
+			o++;
+		}
+	}
+	return executed;
+}
+
+int CHIP8::block_cache::width(kind k)
+{
+	switch (k)
+	{
+	case LD_DRW: case TIMER_SKIP: return 2;
+	case COUNT_LOOP: return 3;
+	default: return 1;
+	}
+}
+
+void CHIP8::block_cache::run(CHIP8& c, unsigned long long end)
+{
+	unsigned long long left = end - c.cycles;
+	while (left > 0 && !c.endlessLoop)
+	{
+		if (c.pc > 0xFFE)
+		{
+			c.emulateCycle();
+			left--;
+			continue;
+		}
+		dbyte start = c.pc;
+		block& b = table[start];
+		if (!b.valid) build(c, b, start);
+		op const* first = b.ops.data();
+		int n = b.length;
+		if ((unsigned long long)n > left)
+		{
+			// Not enough budget for the whole block: run the ops that fit, up to
+			// the fused op that straddles the limit
+			n = (int)left - first[left].back;
+		}
+		int executed = execute(c, first, first + n);
+		c.cycles += executed;
+		left -= executed;
+		if (n < b.length && c.pc == start + 2 * n)
+		{
+			// The interpreter runs the straddling op, the block picks up after it
+			for (int i = width(first[n].what); i > 0 && left > 0 && !c.endlessLoop; i--)
+			{
+				c.emulateCycle();
+				left--;
+			}
+		}
+	}
+}
+
+int CHIP8::block_cache::invalidate(dbyte addr)
+{
+	if (!code[addr]) return 0;
+
+	int dropped = 0;
+	for (int start = max(0, addr - 2 * MAX_BLOCK); start <= addr; start++)
+	{
+		block& b = table[start];
+		if (b.valid && addr < start + b.bytes)
+		{
+			b.valid = false;
+			dropped++;
+		}
+	}
+	return dropped;
+}
+
+void CHIP8::block_cache::flush()
+{
+	for (block& b : table) b.valid = false;
+	code.fill(false);
+}
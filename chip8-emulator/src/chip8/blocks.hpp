@@ -0,0 +1,86 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Internal header: basic-block cache used by CHIP8::engine::block
+
+#ifndef CHIP8_BLOCKS_H
+#define CHIP8_BLOCKS_H
+
+#include "CHIP8.hpp"
+#include <vector>
+
+struct CHIP8::block_cache
+{
+	// What an op does. Blocks dispatch with a switch over this instead of
+	// calling through instruction::exec, so handlers get inlined
+	enum kind : byte
+	{
+		CLS, RET, JP, CALL, SE_BYTE, SNE_BYTE, SE_REG, LD_BYTE, ADD_BYTE,
+		LD_REG, OR_REG, AND_REG, XOR_REG, ADD_REG, SUB_REG, SHR, SUBN, SHL,
+		SNE_REG, LD_I, JP_V0, RND, DRW, SKP, SKNP, LD_VX_DT, LD_K, LD_DT,
+		LD_ST, ADD_I, LD_F, LD_B, STORE, LOAD, UNKNOWN,
+
+		// Superinstructions
+		LD_DRW,     // LD Vx, byte; DRW Vx, Vy, nibble
+		TIMER_SKIP, // LD Vx, DT; SE Vx, byte
+		COUNT_LOOP  // ADD Vx, byte; SE Vx, byte; JP addr
+	};
+
+	struct op
+	{
+		instruction ins;
+		kind what;
+		byte back; // Ops back to the start of the fused op covering this one
+	};
+
+	// Straight-line code up to and including a jump, call, return or key wait.
+	// Skips stay inside, they step over the next op
+	struct block
+	{
+		std::vector<op> ops;
+		int length = 0; // Instructions, at most
+		int bytes = 0;
+		bool valid = false;
+	};
+
+	static constexpr int MAX_BLOCK = 32;
+
+	std::array<block, 4096> table;
+	std::array<bool, 4096> code{}; // Bytes covered by any block since the last flush
+
+	void run(CHIP8& c, unsigned long long end);
+	int invalidate(dbyte addr); // Returns the number of blocks dropped
+	void flush();
+
+private:
+	void build(CHIP8& c, block& b, dbyte start);
+	static kind classify(handler h);
+	static bool endsBlock(kind k);
+	static void fuse(block& b);
+	static int width(kind k); // Instructions an op covers
+	static int execute(CHIP8& c, op const* o, op const* last);
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef CHIP8_ISA_H
+#define CHIP8_ISA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+
+// The instruction set as data, shared by the emulator and the assembler's disassembler.
+// Header only, so chip8-assembler doesn't link chip8-core
+namespace isa
+{
+	// What an instruction does to control flow and memory, for the code window's colors and
+	// chip8-recomp's blocks. JUMP_V0's target is only known at run time
+	enum kind : unsigned char { OTHER, JUMP, JUMP_V0, CALL, RET, SKIP, KEY, DRAW, STORE, LOAD, DATA };
+
+	struct instruction
+	{
+		uint16_t mask, match; // code & mask == match
+		char const* format; // %X, %Y: register, %N: nibble, %B: byte, %A: address, %W: the opcode, in hex
+		kind what;
+	};
+
+	// By Cowgod's Technical Reference, in the assembler's syntax. The first match wins
+	constexpr instruction instructions[] =
+	{
+		{ 0xFFFF, 0x00E0, "cls", OTHER },
+		{ 0xFFFF, 0x00EE, "ret", RET },
+		{ 0xF000, 0x1000, "jp 0x%A", JUMP },
+		{ 0xF000, 0x2000, "call 0x%A", CALL },
+		{ 0xF000, 0x3000, "se V%X, 0x%B", SKIP },
+		{ 0xF000, 0x4000, "sne V%X, 0x%B", SKIP },
+		{ 0xF00F, 0x5000, "se V%X, V%Y", SKIP },
+		{ 0xF000, 0x6000, "ld V%X, 0x%B", OTHER },
+		{ 0xF000, 0x7000, "add V%X, 0x%B", OTHER },
+		{ 0xF00F, 0x8000, "ld V%X, V%Y", OTHER },
+		{ 0xF00F, 0x8001, "or V%X, V%Y", OTHER },
+		{ 0xF00F, 0x8002, "and V%X, V%Y", OTHER },
+		{ 0xF00F, 0x8003, "xor V%X, V%Y", OTHER },
+		{ 0xF00F, 0x8004, "add V%X, V%Y", OTHER },
+		{ 0xF00F, 0x8005, "sub V%X, V%Y", OTHER },
+		{ 0xF00F, 0x8006, "shr V%X", OTHER },
+		{ 0xF00F, 0x8007, "subn V%X, V%Y", OTHER },
+		{ 0xF00F, 0x800E, "shl V%X", OTHER },
+		{ 0xF000, 0x9000, "sne V%X, V%Y", SKIP },
+		{ 0xF000, 0xA000, "ld I, 0x%A", OTHER },
+		{ 0xF000, 0xB000, "jp V0, 0x%A", JUMP_V0 },
+		{ 0xF000, 0xC000, "rnd V%X, 0x%B", OTHER },
+		{ 0xF000, 0xD000, "drw V%X, V%Y, 0x%N", DRAW },
+		{ 0xF0FF, 0xE09E, "skp V%X", SKIP },
+		{ 0xF0FF, 0xE0A1, "sknp V%X", SKIP },
+		{ 0xF0FF, 0xF007, "ld V%X, DT", OTHER },
+		{ 0xF0FF, 0xF00A, "ld V%X, K", KEY },
+		{ 0xF0FF, 0xF015, "ld DT, V%X", OTHER },
+		{ 0xF0FF, 0xF018, "ld ST, V%X", OTHER },
+		{ 0xF0FF, 0xF01E, "add I, V%X", OTHER },
+		{ 0xF0FF, 0xF029, "ld F, V%X", OTHER },
+		{ 0xF0FF, 0xF033, "ld B, V%X", STORE },
+		{ 0xF0FF, 0xF055, "ld [I], V%X", STORE },
+		{ 0xF0FF, 0xF065, "ld V%X, [I]", LOAD },
+	};
+	constexpr instruction data = { 0x0000, 0x0000, "dw 0x%W", DATA }; // Anything else
+
+	constexpr size_t TEXT_SIZE = 16; // Longest text, "drw Va, Vb, 0xf", with the terminating zero
+
+	constexpr instruction find(uint16_t code)
+	{
+		for (instruction const& ins : instructions)
+			if ((code & ins.mask) == ins.match) return ins;
+		return data;
+	}
+
+	// Writes the text of code and a terminating zero to out (TEXT_SIZE chars), returns the length
+	constexpr size_t format(uint16_t code, char* out)
+	{
+		size_t length = 0;
+		for (char const* f = find(code).format; *f; f++)
+		{
+			if (*f != '%')
+			{
+				out[length++] = *f;
+				continue;
+			}
+			unsigned value = code;
+			int digits = 1;
+			switch (*++f)
+			{
+			case 'X': value = code >> 8 & 0xF; break;
+			case 'Y': value = code >> 4 & 0xF; break;
+			case 'N': value = code & 0xF; break;
+			case 'B': value = code & 0xFF; break;
+			case 'A': value = code & 0xFFF; break;
+			case 'W': digits = 4; break;
+			}
+			while (digits < 4 && value >> 4 * digits) digits++;
+			while (digits--) out[length++] = "0123456789abcdef"[value >> 4 * digits & 0xF];
+		}
+		out[length] = 0;
+		return length;
+	}
+
+	// Text of every opcode, formatted once on first use (1 MB)
+	inline char const* text(uint16_t code)
+	{
+		static std::vector<std::array<char, TEXT_SIZE>> const texts = []
+		{
+			std::vector<std::array<char, TEXT_SIZE>> res(0x10000);
+			for (size_t code = 0; code < res.size(); code++) format((uint16_t)code, res[code].data());
+			return res;
+		}();
+		return texts[code].data();
+	}
+}
+
+#endif
@@ -0,0 +1,430 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "jit.hpp"
+#include "ops.hpp"
+
+#include <cstring>
+#include <vector>
+
+#ifdef CHIP8_JIT_X64
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+using namespace std;
+
+namespace
+{
+#ifdef CHIP8_JIT_X64
+	unsigned char* allocateCode(size_t size)
+	{
+#ifdef _WIN32
+		return (unsigned char*)VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return p == MAP_FAILED ? nullptr : (unsigned char*)p;
+#endif
+	}
+
+	void releaseCode(unsigned char* p, size_t size)
+	{
+#ifdef _WIN32
+		VirtualFree(p, 0, MEM_RELEASE);
+#else
+		munmap(p, size);
+#endif
+	}
+
+	// The buffer is never writable and executable at the same time
+	void protectCode(unsigned char* p, size_t size, bool writable)
+	{
+#ifdef _WIN32
+		DWORD old;
+		VirtualProtect(p, size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old);
+		if (!writable) FlushInstructionCache(GetCurrentProcess(), p, size);
+#else
+		mprotect(p, size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+	}
+#endif
+
+	// Encoder for the few x86-64 forms the translator needs.
+	// eax, ecx and edx are temporaries, rbx points to the CHIP8 object,
+	// r8b..r15b hold the V registers a block uses most
+	enum { EAX, ECX, EDX, EBX };
+	enum { CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7 };
+	enum { ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29, ALU_XOR = 0x31, ALU_CMP = 0x39 };
+
+	struct emitter
+	{
+		vector<unsigned char> out;
+		int32_t vBase = 0; // Offset of CHIP8::v
+		array<int, 16> host; // r8 + host[i] keeps Vi, -1 if Vi stays in memory
+		array<bool, 16> written{};
+
+		void b(initializer_list<int> bytes) { for (int x : bytes) out.push_back((unsigned char)x); }
+		void d16(int x) { b({ x & 0xFF, (x >> 8) & 0xFF }); }
+		void d32(int32_t x) { for (int i = 0; i < 4; i++) out.push_back((unsigned char)(x >> (i * 8))); }
+		static int modrm(int mod, int r, int rm) { return mod << 6 | (r & 7) << 3 | (rm & 7); }
+
+		// t = Vi, zero extended
+		void load(int t, int i)
+		{
+			if (host[i] >= 0) b({ 0x41, 0x0F, 0xB6, modrm(3, t, host[i]) });
+			else loadMem(t, vBase + i);
+		}
+		// Vi = low byte of t
+		void store(int i, int t)
+		{
+			written[i] = true;
+			if (host[i] >= 0) b({ 0x41, 0x88, modrm(3, t, host[i]) });
+			else storeMem8(vBase + i, t);
+		}
+		void set(int i, int imm)
+		{
+			written[i] = true;
+			if (host[i] >= 0) b({ 0x41, 0xB0 + host[i], imm });
+			else { b({ 0xC6, modrm(2, 0, EBX) }); d32(vBase + i); b({ imm }); }
+		}
+
+		void loadMem(int t, int32_t disp) { b({ 0x0F, 0xB6, modrm(2, t, EBX) }); d32(disp); }
+		void storeMem8(int32_t disp, int t) { b({ 0x88, modrm(2, t, EBX) }); d32(disp); }
+		void storeMem16(int32_t disp, int t) { b({ 0x66, 0x89, modrm(2, t, EBX) }); d32(disp); }
+		void storeMem16Imm(int32_t disp, int imm) { b({ 0x66, 0xC7, modrm(2, 0, EBX) }); d32(disp); d16(imm); }
+		void addMem16(int32_t disp, int t) { b({ 0x66, 0x01, modrm(2, t, EBX) }); d32(disp); }
+		void cmpMem16Imm(int32_t disp, int imm) { b({ 0x66, 0x81, modrm(2, 7, EBX) }); d32(disp); d16(imm); }
+		// t = byte [rbx + t + disp]
+		void loadIndexed(int t, int32_t disp) { b({ 0x0F, 0xB6, modrm(2, t, 4), t << 3 | EBX }); d32(disp); }
+
+		void alu(int op, int dst, int src) { b({ op, modrm(3, src, dst) }); }
+		void aluImm(int op, int dst, int32_t imm) { b({ 0x81, modrm(3, op >> 3, dst) }); d32(imm); } // op is one of ALU_*
+		void movImm(int t, int32_t imm) { b({ 0xB8 + t }); d32(imm); }
+		void mov(int dst, int src) { b({ 0x89, modrm(3, src, dst) }); }
+		void shr(int t, int n) { b({ 0xC1, modrm(3, 5, t), n }); }
+		void shl(int t, int n) { b({ 0xC1, modrm(3, 4, t), n }); }
+		void imul(int t, int imm) { b({ 0x6B, modrm(3, t, t), imm }); }
+		void setcc(int cc, int t) { b({ 0x0F, 0x90 + cc, modrm(3, 0, t) }); }
+		void cmov(int cc, int dst, int src) { b({ 0x0F, 0x40 + cc, modrm(3, dst, src) }); }
+
+		// Returns where the rel32 is, for patch()
+		size_t jcc(int cc) { b({ 0x0F, 0x80 + cc }); d32(0); return out.size() - 4; }
+		size_t jmp() { b({ 0xE9 }); d32(0); return out.size() - 4; }
+		void patch(size_t at, size_t target)
+		{
+			int32_t rel = (int32_t)(target - (at + 4));
+			memcpy(&out[at], &rel, 4);
+		}
+	};
+
+	bool translatable(CHIP8::instruction const& ins, CHIP8::handler const* supported, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			if (supported[i] == ins.exec) return true;
+		return false;
+	}
+}
+
+CHIP8::jit_cache::jit_cache()
+{
+#ifdef CHIP8_JIT_X64
+	buffer = allocateCode(BUFFER_SIZE);
+	if (buffer) protectCode(buffer, BUFFER_SIZE, false);
+#endif
+}
+
+CHIP8::jit_cache::~jit_cache()
+{
+#ifdef CHIP8_JIT_X64
+	if (buffer) releaseCode(buffer, BUFFER_SIZE);
+#endif
+}
+
+// Translates straight-line code from start up to the first jump or skip, or up to
+// the first instruction that has side effects beyond registers, timers and I (those
+// run in the interpreter). Returns false if nothing could be translated
+bool CHIP8::jit_cache::compile(CHIP8& c, dbyte start, entry& e)
+{
+#ifdef CHIP8_JIT_X64
+	using o = CHIP8::ops;
+	static const handler straight[] =
+	{
+		o::ldByte, o::addByte, o::ldReg, o::orReg, o::andReg, o::xorReg, o::addReg, o::subReg,
+		o::shr, o::subn, o::shl, o::ldI, o::ldVxDT, o::ldDT, o::ldST, o::addI, o::ldF
+	};
+	static const handler branches[] =
+	{
+		o::jp, o::jpV0, o::seByte, o::sneByte, o::seReg, o::sneReg, o::skp, o::sknp
+	};
+
+	if (!buffer) return false;
+
+	vector<instruction> block;
+	int addr = start;
+	while ((int)block.size() < MAX_BLOCK && addr < 0xFFF && !modified[addr >> 8] && !modified[(addr + 1) >> 8])
+	{
+		instruction const& ins = c.opcodes[c.fetch(addr)];
+		bool branch = translatable(ins, branches, size(branches));
+		if (!branch && !translatable(ins, straight, size(straight))) break;
+		if (ins.exec == o::jp && ins.addr == 0xFFF) break; // Endless loop check below reads two bytes
+		block.push_back(ins);
+		addr += 2;
+		if (branch) break;
+	}
+	if (block.empty()) return false;
+
+	auto offset = [&c](void const* member) { return (int32_t)((char const*)member - (char const*)&c); };
+	int32_t pcOff = offset(&c.pc), iOff = offset(&c.I), ramOff = offset(c.ram.data());
+
+	emitter a;
+	a.vBase = offset(c.v.data());
+
+	// The most used V registers go to host registers for the whole block
+	array<int, 16> uses{};
+	for (instruction const& ins : block)
+	{
+		if (ins.exec != o::jp && ins.exec != o::ldI && ins.exec != o::jpV0) uses[ins.x]++;
+		if (ins.exec == o::seReg || ins.exec == o::sneReg || ins.exec == o::ldReg || ins.exec == o::orReg
+			|| ins.exec == o::andReg || ins.exec == o::xorReg || ins.exec == o::addReg || ins.exec == o::subReg
+			|| ins.exec == o::subn) uses[ins.y]++;
+		if (ins.exec == o::addReg || ins.exec == o::subReg || ins.exec == o::shr || ins.exec == o::subn
+			|| ins.exec == o::shl) uses[0xF]++;
+		if (ins.exec == o::jpV0) uses[0]++;
+	}
+	a.host.fill(-1);
+	for (int slot = 0; slot < 8; slot++)
+	{
+		int best = -1;
+		for (int i = 0; i < 16; i++)
+			if (a.host[i] < 0 && uses[i] >= 2 && (best < 0 || uses[i] > uses[best])) best = i;
+		if (best < 0) break;
+		a.host[best] = slot;
+	}
+
+	// Prologue: save rbx and r12..r15, take the CHIP8 pointer, load the allocated registers
+	a.b({ 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57 });
+#ifdef _WIN32
+	a.b({ 0x48, 0x89, 0xCB }); // mov rbx, rcx
+#else
+	a.b({ 0x48, 0x89, 0xFB }); // mov rbx, rdi
+#endif
+	for (int i = 0; i < 16; i++)
+	{
+		if (a.host[i] < 0) continue;
+		a.b({ 0x44, 0x8A, emitter::modrm(2, a.host[i], EBX) });
+		a.d32(a.vBase + i);
+	}
+
+	vector<size_t> exits;
+	int count = 0;
+	dbyte at = start;
+	bool ended = false;
+	for (instruction const& ins : block)
+	{
+		count++;
+		dbyte next = at + 2;
+		handler h = ins.exec;
+		int x = ins.x, y = ins.y;
+
+		// Same order of reads and writes as the handlers, so VF aliasing works the same
+		if (h == o::ldByte) a.set(x, ins.nn);
+		else if (h == o::addByte) { a.load(EAX, x); a.aluImm(ALU_ADD, EAX, ins.nn); a.store(x, EAX); }
+		else if (h == o::ldReg) { a.load(EAX, y); a.store(x, EAX); }
+		else if (h == o::orReg || h == o::andReg || h == o::xorReg)
+		{
+			a.load(EAX, x);
+			a.load(ECX, y);
+			a.alu(h == o::orReg ? ALU_OR : h == o::andReg ? ALU_AND : ALU_XOR, EAX, ECX);
+			a.store(x, EAX);
+		}
+		else if (h == o::addReg)
+		{
+			a.load(EAX, x); a.load(ECX, y); a.alu(ALU_ADD, EAX, ECX);
+			a.aluImm(ALU_CMP, EAX, 0xFF); a.setcc(CC_A, EDX); a.store(0xF, EDX);
+			a.load(EAX, x); a.load(ECX, y); a.alu(ALU_ADD, EAX, ECX); a.store(x, EAX);
+		}
+		else if (h == o::subReg || h == o::subn)
+		{
+			int first = h == o::subReg ? x : y, second = h == o::subReg ? y : x;
+			a.load(EAX, first); a.load(ECX, second); a.alu(ALU_CMP, EAX, ECX); a.setcc(CC_A, EDX); a.store(0xF, EDX);
+			a.load(EAX, first); a.load(ECX, second); a.alu(ALU_SUB, EAX, ECX); a.store(x, EAX);
+		}
+		else if (h == o::shr)
+		{
+			a.load(EAX, x); a.mov(EDX, EAX); a.aluImm(ALU_AND, EDX, 1); a.store(0xF, EDX);
+			a.load(EAX, x); a.shr(EAX, 1); a.store(x, EAX);
+		}
+		else if (h == o::shl)
+		{
+			a.load(EAX, x); a.mov(EDX, EAX); a.shr(EDX, 7); a.aluImm(ALU_AND, EDX, 1); a.store(0xF, EDX);
+			a.load(EAX, x); a.shl(EAX, 1); a.store(x, EAX);
+		}
+		else if (h == o::ldI) a.storeMem16Imm(iOff, ins.addr);
+		else if (h == o::addI) { a.load(EAX, x); a.addMem16(iOff, EAX); }
+		else if (h == o::ldF) { a.load(EAX, x); a.imul(EAX, 5); a.storeMem16(iOff, EAX); }
+		else if (h == o::ldVxDT) { a.loadMem(EAX, offset(&c.delayTimer)); a.store(x, EAX); }
+		else if (h == o::ldDT) { a.load(EAX, x); a.storeMem8(offset(&c.delayTimer), EAX); }
+		else if (h == o::ldST) { a.load(EAX, x); a.storeMem8(offset(&c.soundTimer), EAX); }
+		else if (h == o::jp)
+		{
+			// A jump onto an identical jump is an endless loop: return before it
+			// and let the interpreter catch it
+			a.cmpMem16Imm(ramOff + ins.addr, (ins.code & 0xFF) << 8 | ins.code >> 8);
+			size_t taken = a.jcc(CC_NE);
+			a.storeMem16Imm(pcOff, at);
+			a.movImm(EAX, count - 1);
+			exits.push_back(a.jmp());
+			a.patch(taken, a.out.size());
+			a.storeMem16Imm(pcOff, ins.addr);
+			ended = true;
+		}
+		else if (h == o::jpV0)
+		{
+			a.load(EAX, 0); a.aluImm(ALU_ADD, EAX, ins.addr); a.storeMem16(pcOff, EAX);
+			ended = true;
+		}
+		else
+		{
+			// Skips: pick the next pc without branching
+			int cc;
+			if (h == o::seByte || h == o::sneByte)
+			{
+				a.load(EAX, x);
+				a.aluImm(ALU_CMP, EAX, ins.nn);
+				cc = h == o::seByte ? CC_E : CC_NE;
+			}
+			else if (h == o::seReg || h == o::sneReg)
+			{
+				a.load(EAX, x);
+				a.load(ECX, y);
+				a.alu(ALU_CMP, EAX, ECX);
+				cc = h == o::seReg ? CC_E : CC_NE;
+			}
+			else
+			{
+				a.load(EAX, x);
+				a.aluImm(ALU_AND, EAX, 0xF);
+				a.loadIndexed(EAX, offset(c.keys.data()));
+				a.aluImm(ALU_CMP, EAX, 0);
+				cc = h == o::skp ? CC_NE : CC_E;
+			}
+			a.movImm(EDX, next);
+			a.movImm(ECX, next + 2);
+			a.cmov(cc, EDX, ECX);
+			a.storeMem16(pcOff, EDX);
+			ended = true;
+		}
+		at = next;
+	}
+	if (!ended) a.storeMem16Imm(pcOff, at);
+	a.movImm(EAX, count);
+
+	// Epilogue: write back the registers and restore the host ones
+	for (size_t exit : exits) a.patch(exit, a.out.size());
+	for (int i = 0; i < 16; i++)
+	{
+		if (a.host[i] < 0 || !a.written[i]) continue;
+		a.b({ 0x44, 0x88, emitter::modrm(2, a.host[i], EBX) });
+		a.d32(a.vBase + i);
+	}
+	a.b({ 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 });
+
+	if (used + a.out.size() > BUFFER_SIZE) reset(); // Full: pages found to be modified stay interpreted
+	protectCode(buffer, BUFFER_SIZE, true);
+	memcpy(buffer + used, a.out.data(), a.out.size());
+	protectCode(buffer, BUFFER_SIZE, false);
+
+	e.code = reinterpret_cast<native>(buffer + used);
+	e.length = count;
+	e.bytes = at - start;
+	used = (used + a.out.size() + 15) & ~size_t(15);
+	for (int i = start; i < at; i++) code[i] = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CHIP8::jit_cache::run(CHIP8& c, unsigned long long end)
+{
+	unsigned long long left = end - c.cycles;
+	while (left > 0 && !c.endlessLoop)
+	{
+		if (c.pc <= 0xFFE)
+		{
+			entry& e = table[c.pc];
+			if (!e.code && !e.failed && ++e.hits >= HOT && !compile(c, c.pc, e)) e.failed = true;
+			if (e.code && (unsigned long long)e.length <= left)
+			{
+				int executed = e.code(&c);
+				c.cycles += executed;
+				left -= executed;
+				if (executed == e.length) continue;
+				// Returned before an endless loop jump, the interpreter reports it
+			}
+		}
+		c.emulateCycle();
+		left--;
+	}
+}
+
+int CHIP8::jit_cache::invalidate(dbyte addr)
+{
+	if (!code[addr]) return 0;
+
+	// Self-modifying code: the whole page goes back to the interpreter
+	int page = addr & 0xF00;
+	modified[page >> 8] = true;
+	int dropped = 0;
+	for (int start = max(0, page - 2 * MAX_BLOCK); start < page + 0x100; start++)
+	{
+		entry& e = table[start];
+		if (e.code && start + e.bytes > page)
+		{
+			e.code = nullptr;
+			dropped++;
+		}
+	}
+	for (int i = page; i < page + 0x100; i++) code[i] = false;
+	return dropped;
+}
+
+void CHIP8::jit_cache::flush()
+{
+	reset();
+	modified.fill(false);
+}
+
+void CHIP8::jit_cache::reset()
+{
+	table.fill(entry{});
+	code.fill(false);
+	used = 0;
+}
@@ -0,0 +1,74 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Internal header: x86-64 recompiler used by CHIP8::engine::jit
+
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include "CHIP8.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_X64
+#endif
+
+struct CHIP8::jit_cache
+{
+	using native = int (*)(CHIP8*); // Returns executed instructions, pc is left at the next one
+
+	struct entry
+	{
+		native code = nullptr;
+		int length = 0; // Instructions, unless the block bails out early
+		int bytes = 0;
+		int hits = 0;
+		bool failed = false; // Nothing to compile here, don't retry until a flush
+	};
+
+	static constexpr int MAX_BLOCK = 32;
+	static constexpr int HOT = 16; // Visits of an address before its block is compiled
+	static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+	jit_cache();
+	~jit_cache();
+
+	bool supported() const { return buffer != nullptr; }
+
+	void run(CHIP8& c, unsigned long long end);
+	int invalidate(dbyte addr); // Returns the number of blocks dropped
+	void flush();
+
+private:
+	std::array<entry, 4096> table;
+	std::array<bool, 4096> code{}; // Bytes covered by native code since the last flush
+	std::array<bool, 16> modified{}; // 256-byte pages written after being compiled, only interpreted
+	byte* buffer = nullptr; // Executable memory
+	size_t used = 0;
+
+	bool compile(CHIP8& c, dbyte start, entry& e);
+	void reset(); // Drops the native code, unlike flush keeps the modified pages
+};
+
+#endif
@@ -0,0 +1,146 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "loops.hpp"
+#include "ops.hpp"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+constexpr unsigned long long CHIP8::loop_detector::MIN_SPACING;
+
+uint64_t CHIP8::loop_detector::mix(uint64_t x)
+{
+	// splitmix64 finalizer
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+void CHIP8::loop_detector::reset(CHIP8 const& c)
+{
+	ram = c.ram;
+	ramHash = 0;
+	for (int addr = 0; addr < 4096; addr++) ramHash ^= mix(addr << 8 | ram[addr]);
+	forget();
+}
+
+void CHIP8::loop_detector::forget()
+{
+	referenced = false;
+	power = 1;
+	length = 0;
+	traceEnd = 0;
+}
+
+void CHIP8::loop_detector::write(dbyte addr, byte value)
+{
+	addr &= 0xFFF;
+	// A term per address, so a write swaps one term for another
+	ramHash ^= mix(addr << 8 | ram[addr]) ^ mix(addr << 8 | value);
+	ram[addr] = value;
+}
+
+uint64_t CHIP8::loop_detector::hash(CHIP8 const& c) const
+{
+	// The registers change with almost every instruction, they are hashed here instead
+	uint64_t h = ramHash ^ mix(c.displayHash());
+	uint64_t regs[] =
+	{
+		c.pc | (uint64_t)c.I << 16 | (uint64_t)c.sp << 32 | (uint64_t)c.delayTimer << 40 | (uint64_t)c.soundTimer << 48,
+		(uint64_t)(uint32_t)c.lastKey,
+		c.rng.state, c.rng.inc
+	};
+	for (uint64_t r : regs) h = mix(h ^ r);
+	uint64_t words[4];
+	memcpy(words, c.v.data(), 16);
+	memcpy(words + 2, c.keys.data(), 16);
+	for (uint64_t w : words) h = mix(h ^ w);
+	for (int i = 0; i < 16; i += 4)
+		h = mix(h ^ (c.stack[i] | (uint64_t)c.stack[i + 1] << 16 | (uint64_t)c.stack[i + 2] << 32 | (uint64_t)c.stack[i + 3] << 48));
+	return h;
+}
+
+bool CHIP8::loop_detector::same(state const& a, state const& b)
+{
+	return a.pc == b.pc && a.I == b.I && a.sp == b.sp && a.v == b.v && a.stack == b.stack
+		&& a.delayTimer == b.delayTimer && a.soundTimer == b.soundTimer && a.lastKey == b.lastKey
+		&& a.keys == b.keys && a.rng.state == b.rng.state && a.rng.inc == b.rng.inc
+		&& a.graphicsMap == b.graphicsMap && a.ram == b.ram;
+}
+
+bool CHIP8::loop_detector::sample(CHIP8 const& c)
+{
+	if (traceEnd) return true;
+	if (referenced && c.cycles - lastSample < MIN_SPACING) return false;
+	lastSample = c.cycles;
+
+	uint64_t h = hash(c);
+	if (referenced && h == referenceHash && same(reference, c))
+	{
+		// Equal states are a proof only without anything from outside, that's what the trace checks
+		traceEnd = c.cycles + (c.cycles - reference.cycles);
+		reference = c;
+		range = { c.pc, c.pc };
+		inputRead = false;
+		return true;
+	}
+	if (!referenced || ++length == power)
+	{
+		if (referenced) power *= 2;
+		reference = c;
+		referenceHash = h;
+		referenced = true;
+		length = 0;
+	}
+	return false;
+}
+
+bool CHIP8::loop_detector::trace(CHIP8& c)
+{
+	if (c.cycles < traceEnd)
+	{
+		handler exec = c.opcodes[c.fetch(c.pc)].exec;
+		if (exec == ops::skp || exec == ops::sknp || exec == ops::ldK || exec == ops::ldDT || exec == ops::ldST) inputRead = true;
+		range.start = min(range.start, c.pc);
+		range.end = max(range.end, c.pc);
+		return true;
+	}
+
+	traceEnd = 0;
+	if (!inputRead && same(reference, c))
+	{
+		c.endlessLoop = true;
+		ostringstream text;
+		text << "Caught endless loop at " << hex << showbase << range.start << "-" << range.end;
+		c.infoInternal(text.str());
+	}
+	else forget(); // Not a loop after all: start over from here
+	return false;
+}
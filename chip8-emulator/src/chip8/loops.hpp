@@ -0,0 +1,72 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Internal header: detection of endless loops that CHIP8::ops::jp can't see
+
+#ifndef CHIP8_LOOPS_H
+#define CHIP8_LOOPS_H
+
+#include "CHIP8.hpp"
+
+// A machine that comes back to a state it was in loops forever, unless something from outside
+// breaks the loop. The whole state is hashed at the start of every run() (RAM incrementally, on
+// its writes) and Brent's algorithm finds a sample equal to an earlier one. The period between
+// them is then interpreted once more and traced: if the state comes back again and no instruction
+// in it read the keys or set a timer, nothing can end the loop and its addresses are known
+struct CHIP8::loop_detector
+{
+	// Samples closer than this are skipped, a period is found later but the hashing costs nothing
+	static constexpr unsigned long long MIN_SPACING = 1024;
+
+	explicit loop_detector(CHIP8 const& c) { reset(c); }
+
+	void reset(CHIP8 const& c); // RAM was replaced: rehash it and forget the samples
+	void forget(); // Cycles were skipped: the samples don't follow the execution any more
+	void write(dbyte addr, byte value); // From CHIP8::invalidate()
+
+	bool sample(CHIP8 const& c); // True when a period is to be traced
+	bool trace(CHIP8& c); // Before every instruction of the period, false once it's over
+
+	code_range range = { 0, 0 }; // Of the loop caught
+
+private:
+	std::array<byte, 4096> ram; // As hashed
+	uint64_t ramHash;
+
+	state reference; // Brent's algorithm: the sample compared with
+	uint64_t referenceHash = 0;
+	bool referenced = false;
+	unsigned long long power = 1, length = 0; // Samples taken since the reference, up to power
+	unsigned long long lastSample = 0;
+
+	unsigned long long traceEnd = 0; // The period traced ends here, 0 when none is
+	bool inputRead;
+
+	static uint64_t mix(uint64_t x); // One RAM byte, addressed, as a hash term
+	uint64_t hash(CHIP8 const& c) const;
+	static bool same(state const& a, state const& b); // Everything but the cycle counter
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "movie.hpp"
+
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+static char const MAGIC[4] = { 'C', '8', 'M', 'V' };
+static int const VERSION = 1;
+
+static void putVarint(string& out, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		out += (char)(value | 0x80);
+		value >>= 7;
+	}
+	out += (char)value;
+}
+
+static void putInt(string& out, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++) out += (char)(value >> 8 * i);
+}
+
+// Readers return false when the data ends too early
+static bool getVarint(string const& in, size_t& pos, unsigned long long& value)
+{
+	value = 0;
+	for (int shift = 0; pos < in.size() && shift < 64; shift += 7)
+	{
+		unsigned char b = in[pos++];
+		value |= (unsigned long long)(b & 0x7F) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+static bool getInt(string const& in, size_t& pos, uint64_t& value, int bytes)
+{
+	if (in.size() - pos < (size_t)bytes) return false;
+	value = 0;
+	for (int i = 0; i < bytes; i++) value |= (uint64_t)(unsigned char)in[pos++] << 8 * i;
+	return true;
+}
+
+bool CHIP8Movie::save(string const& path) const
+{
+	string out(MAGIC, sizeof(MAGIC));
+	out += (char)VERSION;
+	putInt(out, seed, 8);
+	putInt(out, romHash, 8);
+	putVarint(out, end);
+
+	unsigned long long cycle = 0;
+	for (input const& in : inputs)
+	{
+		putVarint(out, in.cycle - cycle);
+		cycle = in.cycle;
+		out += (char)in.what;
+		if (in.what == input::SET_RAM) putInt(out, in.addr, 2);
+		if (in.what == input::KEY_DOWN || in.what == input::KEY_UP || in.what == input::SET_RAM) out += (char)in.value;
+	}
+
+	ofstream file(path, ios::out | ios::binary);
+	return file.write(out.data(), out.size()) ? true : false;
+}
+
+bool CHIP8Movie::load(string const& path)
+{
+	ifstream file(path, ios::in | ios::binary);
+	if (!file) return false;
+	string in((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+	size_t pos = sizeof(MAGIC) + 1;
+	if (in.size() < pos || in.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0 || in[4] != VERSION) return false;
+	uint64_t newSeed, newHash;
+	unsigned long long newEnd;
+	if (!getInt(in, pos, newSeed, 8) || !getInt(in, pos, newHash, 8) || !getVarint(in, pos, newEnd)) return false;
+
+	vector<input> newInputs;
+	unsigned long long cycle = 0;
+	while (pos < in.size())
+	{
+		unsigned long long delta;
+		uint64_t addr = 0, value = 0;
+		if (!getVarint(in, pos, delta) || pos == in.size()) return false;
+		input::kind what = (input::kind)in[pos++];
+		if (what > input::RESET_STOP) return false;
+		if (what == input::SET_RAM && !getInt(in, pos, addr, 2)) return false;
+		if ((what == input::KEY_DOWN || what == input::KEY_UP || what == input::SET_RAM) && !getInt(in, pos, value, 1)) return false;
+		cycle += delta;
+		if (cycle > newEnd) return false;
+		newInputs.push_back({ cycle, (CHIP8::dbyte)addr, what, (CHIP8::byte)value });
+	}
+
+	seed = newSeed;
+	romHash = newHash;
+	end = newEnd;
+	inputs = move(newInputs);
+	next = 0;
+	return true;
+}
+
+void CHIP8Movie::record(CHIP8& c)
+{
+	seed = c.getSeed();
+	romHash = c.getRomHash();
+	end = 0;
+	inputs.clear();
+	next = 0;
+	c.inputCallback = [this](input const& in) { inputs.push_back(in); };
+}
+
+bool CHIP8Movie::play(CHIP8& c)
+{
+	if (c.getRomHash() != romHash) return false;
+	c.setSeed(seed);
+	next = 0;
+	return true;
+}
+
+void CHIP8Movie::stop(CHIP8& c)
+{
+	if (c.inputCallback) end = c.getCycles();
+	c.inputCallback = nullptr;
+	next = inputs.size();
+}
+
+unsigned long long CHIP8Movie::run(CHIP8& c, unsigned long long count)
+{
+	unsigned long long begin = c.getCycles(), end = begin + count;
+	for (;;)
+	{
+		while (next < inputs.size() && inputs[next].cycle <= c.getCycles()) c.send(inputs[next++]);
+		if (c.getCycles() >= end || c.caughtEndlessLoop()) break;
+		unsigned long long until = next < inputs.size() ? min(end, inputs[next].cycle) : end;
+		if (fastForward) c.skipIdle(until - c.getCycles()); // Nothing comes to end an idle loop before the next input
+		c.run(until - c.getCycles());
+	}
+	return c.getCycles() - begin;
+}
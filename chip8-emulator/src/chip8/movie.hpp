@@ -0,0 +1,67 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef CHIP8_MOVIE_H
+#define CHIP8_MOVIE_H
+
+#include "CHIP8.hpp"
+#include <string>
+#include <vector>
+
+// Everything a run got from outside (keys, timer ticks, RAM pokes) with the cycles it came
+// at, plus the RNG seed and the ROM, so playing it back repeats the run exactly, with or
+// without a window and with any engine.
+// File: "C8MV", version byte, seed and ROM hash (little endian), length (LEB128), then per
+// input the cycles since the previous one (LEB128), the kind, and the key or the address and value
+class CHIP8Movie
+{
+public:
+	using input = CHIP8::input;
+
+	uint64_t seed = 0;
+	uint64_t romHash = 0;
+	unsigned long long end = 0; // Cycle the recording was stopped at
+	std::vector<input> inputs; // Ordered by cycle
+
+	bool load(std::string const& path);
+	bool save(std::string const& path) const;
+
+	// Both expect a machine that was just loaded
+	void record(CHIP8& c); // Until stop()
+	bool play(CHIP8& c); // False if c runs another ROM
+	void stop(CHIP8& c);
+
+	// Runs up to count instructions, sending the inputs due on the way. Returns executed instructions
+	unsigned long long run(CHIP8& c, unsigned long long count);
+	void setFastForward(bool on) { fastForward = on; } // Skip idle loops up to the next input, on by default
+	bool finished() const { return next == inputs.size(); }
+	unsigned long long length() const { return end; }
+
+private:
+	size_t next = 0; // First input not sent yet
+	bool fastForward = true;
+};
+
+#endif
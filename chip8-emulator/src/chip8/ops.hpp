@@ -0,0 +1,323 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Internal header: instruction handlers shared by the execution engines
+
+#ifndef CHIP8_OPS_H
+#define CHIP8_OPS_H
+
+#include "CHIP8.hpp"
+#include "../common.h"
+
+// Instruction handlers. pc already points to the next instruction when they run
+struct CHIP8::ops
+{
+    static void cls(CHIP8& c, instruction const&)
+    {
+        c.clearDisplay();
+    }
+
+    static void ret(CHIP8& c, instruction const&)
+    {
+        if (c.sp == 0)
+        {
+            c.errorInternal("Stack underflow");
+            return;
+        }
+        c.pc = c.stack[c.sp];
+        c.sp--;
+    }
+
+    static void jp(CHIP8& c, instruction const& ins) // JP addr
+    {
+        c.pc = ins.addr;
+        if (c.fetch(c.pc) == ins.code)
+        {
+            c.endlessLoop = true;
+            c.infoInternal("Caught endless loop");
+        }
+    }
+
+    static void call(CHIP8& c, instruction const& ins) // CALL addr
+    {
+        if (c.sp + 1 >= 16)
+        {
+            c.errorInternal("Stack overflow");
+            return;
+        }
+        c.sp++;
+        c.stack[c.sp] = c.pc;
+        c.pc = ins.addr;
+        if (c.fetch(c.pc) == ins.code)
+        {
+            c.endlessLoop = true;
+            c.infoInternal("Caught endless loop");
+        }
+    }
+
+    static void seByte(CHIP8& c, instruction const& ins) // SE Vx, byte
+    {
+        if (c.v[ins.x] == ins.nn) c.pc += 2;
+    }
+
+    static void sneByte(CHIP8& c, instruction const& ins) // SNE Vx, byte
+    {
+        if (c.v[ins.x] != ins.nn) c.pc += 2;
+    }
+
+    static void seReg(CHIP8& c, instruction const& ins) // SE Vx, Vy
+    {
+        if (c.v[ins.x] == c.v[ins.y]) c.pc += 2;
+    }
+
+    static void ldByte(CHIP8& c, instruction const& ins) // LD Vx, byte
+    {
+        c.v[ins.x] = ins.nn;
+    }
+
+    static void addByte(CHIP8& c, instruction const& ins) // ADD Vx, byte
+    {
+        c.v[ins.x] += ins.nn;
+    }
+
+    static void ldReg(CHIP8& c, instruction const& ins) // LD Vx, Vy
+    {
+        c.v[ins.x] = c.v[ins.y];
+    }
+
+    static void orReg(CHIP8& c, instruction const& ins) // OR Vx, Vy
+    {
+        c.v[ins.x] = c.v[ins.x] | c.v[ins.y];
+    }
+
+    static void andReg(CHIP8& c, instruction const& ins) // AND Vx, Vy
+    {
+        c.v[ins.x] = c.v[ins.x] & c.v[ins.y];
+    }
+
+    static void xorReg(CHIP8& c, instruction const& ins) // XOR Vx, Vy
+    {
+        c.v[ins.x] = c.v[ins.x] ^ c.v[ins.y];
+    }
+
+    static void addReg(CHIP8& c, instruction const& ins) // ADD Vx, Vy
+    {
+        c.v[0xF] = (c.v[ins.x] + c.v[ins.y]) > 0xFF;
+        c.v[ins.x] += c.v[ins.y];
+    }
+
+    static void subReg(CHIP8& c, instruction const& ins) // SUB Vx, Vy
+    {
+        c.v[0xF] = c.v[ins.x] > c.v[ins.y];
+        c.v[ins.x] -= c.v[ins.y];
+    }
+
+    static void shr(CHIP8& c, instruction const& ins) // SHR Vx
+    {
+        c.v[0xF] = c.v[ins.x] & 0b00000001;
+        c.v[ins.x] = c.v[ins.x] >> 1;
+    }
+
+    static void subn(CHIP8& c, instruction const& ins) // SUBN Vx, Vy
+    {
+        c.v[0xF] = c.v[ins.y] > c.v[ins.x];
+        c.v[ins.x] = c.v[ins.y] - c.v[ins.x];
+    }
+
+    static void shl(CHIP8& c, instruction const& ins) // SHL Vx
+    {
+        c.v[0xF] = (c.v[ins.x] & 0b10000000) != 0;
+        c.v[ins.x] <<= 1;
+    }
+
+    static void sneReg(CHIP8& c, instruction const& ins) // SNE Vx, Vy
+    {
+        if (c.v[ins.x] != c.v[ins.y]) c.pc += 2;
+    }
+
+    static void ldI(CHIP8& c, instruction const& ins) // LD I, addr
+    {
+        c.I = ins.addr;
+    }
+
+    static void jpV0(CHIP8& c, instruction const& ins) // JP V0, addr
+    {
+        c.pc = ins.addr + c.v[0];
+    }
+
+    static void rnd(CHIP8& c, instruction const& ins) // RND Vx, byte
+    {
+        c.v[ins.x] = c.rng.next() & ins.nn;
+    }
+
+    static void drw(CHIP8& c, instruction const& ins) // DRW Vx, Vy, nibble
+    {
+        c.v[0xF] = c.drawAlgorithm(c.v[ins.x], c.v[ins.y], ins.n);
+    }
+
+    static void skp(CHIP8& c, instruction const& ins) // SKP Vx
+    {
+        if (c.keys[c.v[ins.x] & 0xF] == true) c.pc += 2;
+    }
+
+    static void sknp(CHIP8& c, instruction const& ins) // SKNP Vx
+    {
+        if (c.keys[c.v[ins.x] & 0xF] != true) c.pc += 2;
+    }
+
+    static void ldVxDT(CHIP8& c, instruction const& ins) // LD Vx, DT
+    {
+        c.v[ins.x] = c.delayTimer;
+    }
+
+    static void ldK(CHIP8& c, instruction const& ins) // LD Vx, K
+    {
+        if (c.lastKey >= 0)
+        {
+            c.v[ins.x] = c.lastKey;
+            c.lastKey = -1;
+        }
+        else c.pc -= 2;
+    }
+
+    static void ldDT(CHIP8& c, instruction const& ins) // LD DT, Vx
+    {
+        c.delayTimer = c.v[ins.x];
+    }
+
+    static void ldST(CHIP8& c, instruction const& ins) // LD ST, Vx
+    {
+        c.soundTimer = c.v[ins.x];
+    }
+
+    static void addI(CHIP8& c, instruction const& ins) // ADD I, Vx
+    {
+        c.I = c.I + c.v[ins.x];
+    }
+
+    static void ldF(CHIP8& c, instruction const& ins) // LD F, Vx
+    {
+        c.I = c.v[ins.x] * 5;
+    }
+
+    static void ldB(CHIP8& c, instruction const& ins) // LD B, Vx
+    {
+        if (c.I >= 0xFFF) c.errorInternal("Segmentation fault: I >= 0xFFF");
+        c.ram[c.I & 0xFFF] = (c.v[ins.x] / 100) % 10;
+        c.ram[(c.I + 1) & 0xFFF] = (c.v[ins.x] / 10) % 10;
+        c.ram[(c.I + 2) & 0xFFF] = c.v[ins.x] % 10;
+        for (int i = 0; i < 3; i++) c.invalidate(c.I + i);
+    }
+
+    static void store(CHIP8& c, instruction const& ins) // LD [I], Vx
+    {
+        if (c.I >= 0xFFF && ins.x != 0) c.errorInternal("Segmentation fault: I >= 0xFFF");
+        for (int i = 0; i <= ins.x; i++)
+        {
+            c.ram[(c.I + i) & 0xFFF] = c.v[i];
+            c.invalidate(c.I + i);
+        }
+    }
+
+    static void load(CHIP8& c, instruction const& ins) // LD Vx, [I]
+    {
+        if (c.I >= 0xFFF && ins.x != 0) c.errorInternal("Segmentation fault: I >= 0xFFF");
+        for (int i = 0; i <= ins.x; i++)
+        {
+            c.v[i] = c.ram[(c.I + i) & 0xFFF];
+        }
+    }
+
+    static void unknown(CHIP8& c, instruction const& ins)
+    {
+        c.errorInternal("Unknown opcode: " + type_to_hex(ins.code));
+    }
+
+    static constexpr handler select(dbyte code)
+    {
+        if (code == 0xE0) return cls;
+        if (code == 0xEE) return ret;
+
+        switch (code >> 12)
+        {
+        case 0x1: return jp;
+        case 0x2: return call;
+        case 0x3: return seByte;
+        case 0x4: return sneByte;
+        case 0x5: return seReg;
+        case 0x6: return ldByte;
+        case 0x7: return addByte;
+        case 0x8:
+            switch (code & 0x000F)
+            {
+            case 0x0: return ldReg;
+            case 0x1: return orReg;
+            case 0x2: return andReg;
+            case 0x3: return xorReg;
+            case 0x4: return addReg;
+            case 0x5: return subReg;
+            case 0x6: return shr;
+            case 0x7: return subn;
+            case 0xE: return shl;
+            }
+            break;
+        case 0x9: return sneReg;
+        case 0xA: return ldI;
+        case 0xB: return jpV0;
+        case 0xC: return rnd;
+        case 0xD: return drw;
+        case 0xE:
+            switch (code & 0x00FF)
+            {
+            case 0x9E: return skp;
+            case 0xA1: return sknp;
+            }
+            break;
+        case 0xF:
+            switch (code & 0x00FF)
+            {
+            case 0x07: return ldVxDT;
+            case 0x0A: return ldK;
+            case 0x15: return ldDT;
+            case 0x18: return ldST;
+            case 0x1E: return addI;
+            case 0x29: return ldF;
+            case 0x33: return ldB;
+            case 0x55: return store;
+            case 0x65: return load;
+            }
+            break;
+        }
+        return unknown;
+    }
+
+    static constexpr instruction decode(dbyte code)
+    {
+        return { select(code), code, dbyte(code & 0x0FFF), byte((code >> 8) & 0x0F),
+            byte((code >> 4) & 0x0F), byte(code & 0x000F), byte(code & 0x00FF) };
+    }
+};
+
+#endif
\ No newline at end of file
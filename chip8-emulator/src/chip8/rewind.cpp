@@ -0,0 +1,151 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "rewind.hpp"
+
+#include <cstring>
+
+using namespace std;
+
+static void putVarint(CHIP8::byte*& out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = (CHIP8::byte)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (CHIP8::byte)value;
+}
+
+static size_t getVarint(CHIP8::byte const*& in)
+{
+	size_t value = 0;
+	for (int shift = 0;; shift += 7)
+	{
+		CHIP8::byte b = *in++;
+		value |= (size_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) return value;
+	}
+}
+
+CHIP8::rewind_buffer::rewind_buffer() : ring(CAPACITY), scratch(2 * sizeof(state) + 16)
+{
+}
+
+// Runs of (unchanged bytes, changed bytes, the changed bytes XOR-ed with base).
+// A single unchanged byte doesn't end a run of changed ones, it would cost more than it saves
+size_t CHIP8::rewind_buffer::encode(byte const* now, byte const* base, byte* out)
+{
+	byte* begin = out;
+	size_t n = sizeof(state), i = 0;
+	while (i < n)
+	{
+		size_t same = i;
+		while (i < n && now[i] == base[i]) i++;
+		if (i == n) break;
+		size_t changed = i;
+		while (i < n && (now[i] != base[i] || (i + 1 < n && now[i + 1] != base[i + 1]))) i++;
+
+		putVarint(out, changed - same);
+		putVarint(out, i - changed);
+		for (size_t j = changed; j < i; j++) *out++ = now[j] ^ base[j];
+	}
+	return out - begin;
+}
+
+void CHIP8::rewind_buffer::decode(byte const* in, size_t length, byte* s)
+{
+	byte const* end = in + length;
+	size_t i = 0;
+	while (in != end)
+	{
+		i += getVarint(in);
+		size_t changed = getVarint(in);
+		for (size_t j = 0; j < changed; j++) s[i++] ^= *in++;
+	}
+}
+
+void CHIP8::rewind_buffer::dropOldest()
+{
+	records.pop_front();
+	while (!records.empty() && !records.front().keyframe) records.pop_front();
+}
+
+size_t CHIP8::rewind_buffer::reserve(size_t length)
+{
+	// Records are written in order, so the ones past head are the oldest
+	if (head + length > ring.size())
+	{
+		while (!records.empty() && records.front().offset >= head) dropOldest();
+		head = 0;
+	}
+	while (!records.empty() && records.front().offset >= head && records.front().offset < head + length)
+		dropOldest();
+
+	size_t offset = head;
+	head += length;
+	return offset;
+}
+
+void CHIP8::rewind_buffer::record(state const& s)
+{
+	static state const zero{};
+	bool keyframe = records.empty() || ++sinceKeyframe >= KEYFRAME;
+	if (keyframe) sinceKeyframe = 0;
+
+	byte const* base = (byte const*)(keyframe ? &zero : &last);
+	size_t length = encode((byte const*)&s, base, scratch.data());
+	size_t offset = reserve(length);
+	memcpy(ring.data() + offset, scratch.data(), length);
+	records.push_back({ offset, length, keyframe });
+	last = s;
+}
+
+int CHIP8::rewind_buffer::rewind(int frames, state& out)
+{
+	if (records.empty()) return 0;
+
+	int newest = size() - 1;
+	int target = max(0, newest - max(0, frames));
+	int keyframe = target;
+	while (!records[keyframe].keyframe) keyframe--;
+
+	out = state{};
+	for (int i = keyframe; i <= target; i++)
+		decode(ring.data() + records[i].offset, records[i].length, (byte*)&out);
+
+	records.erase(records.begin() + target + 1, records.end());
+	head = records.back().offset + records.back().length;
+	last = out;
+	sinceKeyframe = target - keyframe;
+	return newest - target;
+}
+
+void CHIP8::rewind_buffer::clear()
+{
+	records.clear();
+	head = 0;
+	sinceKeyframe = 0;
+}
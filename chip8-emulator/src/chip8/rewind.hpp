@@ -0,0 +1,71 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Internal header: history of frame snapshots used by CHIP8::rewind
+
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include "CHIP8.hpp"
+#include <deque>
+#include <vector>
+
+// Every KEYFRAME-th snapshot is stored XOR-ed with zeroes, the ones in between XOR-ed with
+// the previous snapshot, both run-length encoded. Between frames only a few registers, display
+// bytes and the cycle counter change, so a frame takes tens of bytes instead of 4.4 KB.
+// Records are packed into a fixed ring; the oldest keyframe group goes when it's full
+struct CHIP8::rewind_buffer
+{
+	static constexpr size_t CAPACITY = 8 << 20; // Bytes, roughly an hour of a typical ROM
+	static constexpr int KEYFRAME = 60;
+
+	rewind_buffer();
+
+	void record(state const& s);
+	int rewind(int frames, state& out); // Returns frames actually rewound, out is the state then
+	int size() const { return (int)records.size(); }
+	void clear();
+
+private:
+	struct entry
+	{
+		size_t offset, length;
+		bool keyframe;
+	};
+
+	std::vector<byte> ring;
+	std::vector<byte> scratch; // Worst case encoding of one snapshot
+	size_t head = 0; // Where the next record goes
+	std::deque<entry> records; // Oldest first
+	state last; // Decoded newest record, the base of the next delta
+	int sinceKeyframe = 0;
+
+	static size_t encode(byte const* now, byte const* base, byte* out);
+	static void decode(byte const* in, size_t length, byte* s); // XORs the delta into s
+	size_t reserve(size_t length); // Drops the oldest records that are in the way
+	void dropOldest(); // With the deltas that depend on it
+};
+
+#endif
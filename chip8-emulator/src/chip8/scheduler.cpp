@@ -0,0 +1,84 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+unsigned long long const CHIP8Scheduler::TIMER_HZ;
+constexpr chrono::milliseconds CHIP8Scheduler::MAX_LAG;
+
+void CHIP8Scheduler::setSpeed(unsigned long long ips)
+{
+	speed = max(ips, TIMER_HZ);
+	tickFrom = 1;
+	tickAt = 0;
+}
+
+unsigned long long CHIP8Scheduler::due(clock::time_point now)
+{
+	if (!throttled) return (speed + TIMER_HZ - 1) / TIMER_HZ;
+	if (!started)
+	{
+		started = true;
+		last = now;
+		owed = 0;
+		return 0;
+	}
+	auto passed = min<clock::duration>(now - last, MAX_LAG);
+	last = now;
+	owed += (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(passed).count() * speed;
+	unsigned long long count = owed / 1000000000ULL;
+	owed %= 1000000000ULL;
+	return count;
+}
+
+unsigned long long CHIP8Scheduler::nextTick(unsigned long long cycle)
+{
+	if (cycle < tickFrom || cycle >= tickAt)
+	{
+		// Smallest k with k * speed / 60 > cycle
+		unsigned long long k = (TIMER_HZ * (cycle + 1) + speed - 1) / speed;
+		tickFrom = cycle;
+		tickAt = k * speed / TIMER_HZ;
+	}
+	return tickAt;
+}
+
+unsigned long long CHIP8Scheduler::run(CHIP8& c, unsigned long long count)
+{
+	unsigned long long begin = c.getCycles(), end = begin + count;
+	while (c.getCycles() < end && !c.caughtEndlessLoop())
+	{
+		unsigned long long tick = nextTick(c.getCycles());
+		unsigned long long until = min(end, tick);
+		if (fastForward) c.skipIdle(until - c.getCycles());
+		if (c.getCycles() < until && c.run(until - c.getCycles()) == 0) break;
+		if (c.getCycles() == tick) c.tickTimers();
+	}
+	return c.getCycles() - begin;
+}
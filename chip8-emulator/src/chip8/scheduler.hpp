@@ -0,0 +1,70 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef CHIP8_SCHEDULER_H
+#define CHIP8_SCHEDULER_H
+
+#include "CHIP8.hpp"
+#include <chrono>
+
+// Emulated time: the machine runs a number of instructions per second and its timers tick
+// at 60 Hz of the same time, timer tick k comes after instruction k * speed / 60.
+// Throttled, due() paces the machine by the host clock; unthrottled, it runs as fast as it can.
+// The ticks are inputs, so they are journaled and recorded into movies like keys
+class CHIP8Scheduler
+{
+public:
+	using clock = std::chrono::steady_clock;
+	static unsigned long long const TIMER_HZ = 60;
+
+	explicit CHIP8Scheduler(unsigned long long ips = 600) { setSpeed(ips); }
+
+	void setSpeed(unsigned long long ips); // At least TIMER_HZ
+	unsigned long long getSpeed() const { return speed; }
+	void setThrottled(bool on) { throttled = on; started = false; }
+	bool isThrottled() const { return throttled; }
+	void setFastForward(bool on) { fastForward = on; } // Skip idle loops up to the next tick, on by default
+
+	// Instructions owed for the host time since the last call, at most MAX_LAG worth of it so a stall
+	// isn't made up in a burst. Unthrottled, the instructions of one timer period
+	unsigned long long due(clock::time_point now);
+
+	// Runs up to count instructions, ticking the timers on the way. Returns executed instructions
+	unsigned long long run(CHIP8& c, unsigned long long count);
+	unsigned long long nextTick(unsigned long long cycle); // First tick after cycle
+
+private:
+	static constexpr std::chrono::milliseconds MAX_LAG{ 100 };
+
+	unsigned long long speed;
+	bool throttled = true;
+	bool started = false;
+	bool fastForward = true;
+	clock::time_point last;
+	unsigned long long owed = 0; // Instructions times 1e9 not run yet, below one instruction
+	unsigned long long tickFrom = 1, tickAt = 0; // nextTick() of every cycle in [tickFrom, tickAt) is tickAt
+};
+
+#endif
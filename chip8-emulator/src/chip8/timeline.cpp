@@ -0,0 +1,122 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "timeline.hpp"
+
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+void CHIP8::timeline::take(CHIP8 const& c)
+{
+	if (!checkpoints.empty() && checkpoints.back().cycle == c.cycles) checkpoints.pop_back();
+	checkpoints.push_back({ c.cycles, events.size(), c });
+	if (checkpoints.size() > MAX_CHECKPOINTS)
+	{
+		size_t kept = 1;
+		for (size_t i = 2; i < checkpoints.size(); i += 2) checkpoints[kept++] = checkpoints[i];
+		checkpoints.resize(kept);
+		interval *= 2;
+	}
+	nextCheckpoint = c.cycles + interval;
+}
+
+void CHIP8::timeline::clear()
+{
+	events.clear();
+	checkpoints.clear();
+	nextCheckpoint = 0;
+}
+
+void CHIP8::timeline::rebase(CHIP8 const& c)
+{
+	truncate(c.cycles);
+	take(c);
+}
+
+size_t CHIP8::timeline::before(unsigned long long cycle) const
+{
+	auto it = upper_bound(checkpoints.begin(), checkpoints.end(), cycle,
+		[](unsigned long long cycle, checkpoint const& cp) { return cycle < cp.cycle; });
+	return it - checkpoints.begin() - 1;
+}
+
+void CHIP8::timeline::truncate(unsigned long long cycle)
+{
+	auto it = upper_bound(events.begin(), events.end(), cycle,
+		[](unsigned long long cycle, input const& e) { return cycle < e.cycle; });
+	events.erase(it, events.end());
+	while (!checkpoints.empty() && checkpoints.back().cycle > cycle) checkpoints.pop_back();
+	nextCheckpoint = checkpoints.empty() ? 0 : checkpoints.back().cycle + interval;
+}
+
+template<typename Visit>
+void CHIP8::timeline::replay(CHIP8& c, checkpoint const& from, unsigned long long cycle, Visit visit)
+{
+	c.restore(from.s);
+	unsigned long long next = nextCheckpoint;
+	nextCheckpoint = ULLONG_MAX; // Everything up to cycle is already recorded
+	size_t e = from.event;
+	for (;;)
+	{
+		while (e < events.size() && events[e].cycle <= c.cycles) c.apply(events[e++]);
+		visit(c);
+		if (c.cycles >= cycle || c.endlessLoop) break;
+		c.emulateCycle();
+	}
+	nextCheckpoint = next;
+}
+
+bool CHIP8::timeline::seek(CHIP8& c, unsigned long long cycle)
+{
+	if (checkpoints.empty() || cycle < checkpoints.front().cycle || cycle > c.cycles) return false;
+
+	replay(c, checkpoints[before(cycle)], cycle, [](CHIP8 const&) {});
+	// Inputs after this point belonged to the abandoned future
+	truncate(c.cycles);
+	return c.cycles == cycle;
+}
+
+bool CHIP8::timeline::reverseContinue(CHIP8& c, dbyte breakpoint)
+{
+	if (checkpoints.empty() || c.cycles <= checkpoints.front().cycle) return false;
+
+	// Segments between checkpoints are searched newest first, the last hit before the
+	// current cycle wins
+	unsigned long long end = c.cycles;
+	for (size_t k = before(end);; k--)
+	{
+		checkpoint const& from = checkpoints[k];
+		unsigned long long hit = ULLONG_MAX;
+		if (from.cycle < end)
+			replay(c, from, end - 1, [&](CHIP8 const& m) { if (m.pc == breakpoint) hit = m.cycles; });
+		if (hit != ULLONG_MAX) return seek(c, hit);
+		end = from.cycle; // The older segments end where this one starts, each is replayed once
+		if (k == 0) break;
+	}
+	seek(c, checkpoints.front().cycle);
+	return false;
+}
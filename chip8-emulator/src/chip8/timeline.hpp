@@ -0,0 +1,75 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Internal header: checkpoints and input journal used by the reverse debugger
+
+#ifndef CHIP8_TIMELINE_H
+#define CHIP8_TIMELINE_H
+
+#include "CHIP8.hpp"
+#include <vector>
+
+// Everything that changes the machine from outside (keys, timer ticks, RAM pokes) is
+// journaled with the cycle it happened at, and the whole state is copied every interval
+// cycles. Any earlier cycle is reached by restoring the checkpoint before it and
+// interpreting forward with the journaled inputs; the RNG is part of the state
+struct CHIP8::timeline
+{
+	struct checkpoint
+	{
+		unsigned long long cycle;
+		size_t event; // Journal entries already contained in the state
+		state s;
+	};
+
+	// Past this the spacing doubles and every other checkpoint goes, so memory stays
+	// bounded and replays get at most twice as long
+	static constexpr size_t MAX_CHECKPOINTS = 1024;
+
+	unsigned long long interval;
+	unsigned long long nextCheckpoint = 0; // Checked by emulateCycle() and run()
+
+	explicit timeline(unsigned long long interval) : interval(interval) {}
+
+	void log(input const& in) { events.push_back(in); }
+	void take(CHIP8 const& c); // Checkpoint at the current cycle
+	void clear();
+	void rebase(CHIP8 const& c); // The state was replaced from outside: forget its future and start from it
+
+	bool seek(CHIP8& c, unsigned long long cycle);
+	bool reverseContinue(CHIP8& c, dbyte breakpoint);
+	unsigned long long first() const { return checkpoints.empty() ? 0 : checkpoints.front().cycle; }
+
+private:
+	std::vector<input> events; // Ordered by cycle
+	std::vector<checkpoint> checkpoints; // Ordered by cycle
+
+	size_t before(unsigned long long cycle) const; // Last checkpoint at or before cycle
+	void truncate(unsigned long long cycle); // Drops what comes after cycle
+	// Restores checkpoint and interprets up to cycle, calls visit for every cycle reached
+	template<typename Visit> void replay(CHIP8& c, checkpoint const& from, unsigned long long cycle, Visit visit);
+};
+
+#endif
@@ -32,7 +32,6 @@ SOFTWARE.
 #include <sstream>
 #include <vector>
 #include <algorithm>
-#include <random>
 #include <chrono>
 
 #define WHITE IM_COL32(255, 255, 255, 255)
@@ -42,17 +41,6 @@ SOFTWARE.
 #define YELLOW IM_COL32(234, 183, 0, 255)
 #define GREEN IM_COL32(0, 230, 0, 255)
 
-inline int random(int min, int max)
-{
-    static bool first = true;
-    if (first)
-    {
-        srand((unsigned int)time(NULL));
-        first = false;
-    }
-    return min + rand() % ((max + 1) - min);
-}
-
 template<typename T>
 inline std::string type_to_hex(T i)
 {
@@ -24,6 +24,8 @@ SOFTWARE.
 */
 
 #include "common.h"
+#include <climits>
+#include <thread>
 
 #define SDL_MAIN_HANDLED
 
@@ -37,12 +39,21 @@ SOFTWARE.
 
 #include "log/logger.hpp"
 #include "chip8/CHIP8.hpp"
+#include "chip8/movie.hpp"
+#include "chip8/scheduler.hpp"
+#include "chip8/isa.hpp"
+#include "sync.hpp"
 
 #define START_ROM "chip8start.ch8"
 #define TEXT_CMP1(cmd, txt1) (!strcmp((cmd), #txt1))
 #define TEXT_CMP2(cmd, txt1, txt2) (!strcmp((cmd), #txt1) || !strcmp((cmd), #txt2))
 #define TEXT_CMP3(cmd, txt1, txt2, txt3) (!strcmp((cmd), #txt1) || !strcmp((cmd), #txt2) || !strcmp((cmd), #txt3))
 #define MS_PER_FRAME 10
+#define SETTLE_FRAMES 3 // Drawn after any input, ImGui needs a few to show hovers and clicks
+#define STATUS_MS 100 // Registers and code that change while the display doesn't are redrawn this often
+#define HIDDEN_WAIT_MS 250 // Event wait while the window is hidden or minimized
+#define SPEED_STEP 100 // Instructions per second, changed by the + and - buttons
+#define CHECKPOINT_INTERVAL 10000 // Cycles, bounds the replay behind stepback and reverse-continue
 
 static inline ImVec2 operator+(ImVec2 lhs, ImVec2 rhs) { return ImVec2(lhs.x + rhs.x, lhs.y + rhs.y); }
 
@@ -86,9 +97,18 @@ ImVec2 windowMax, windowMin; // Content region
 bool filledStyle = true;
 bool colorsInverted = false;
 
+// Display texture: the framebuffer drawn as one quad, the rows the core reports changed are regenerated
+SDL_Texture* displayTexture = NULL;
+vector<uint32_t> displayPixels;
+int cellWidth = 0, cellHeight = 0; // Texels per CHIP-8 pixel, so the gaps of the outline style are a screen pixel wide
+array<unsigned long long, 32> shownGenerations{}; // frame::rowGenerations the texture was made from
+bool shownFilled, shownInverted;
+bool displayTextureValid = false;
+
 // Drawing functions
 void drawMenu();
 void drawDisplay();
+void updateDisplayTexture();
 void drawCodeWindow();
 void drawCommandsWindow();
 void drawStatusWindow();
@@ -96,15 +116,60 @@ void drawStatusWindow();
 // Other
 inline void TextCentered(const char* text);
 inline void TextRighted(const char* text);
-void addTextToLog(string const& text); // Used as callback for CHIP-8 class
+void addTextToLog(string const& text); // Logs and shows in the console, GUI thread
 
-// Internal
+// Emulation thread: the machine and the vars below are only touched there,
+// or in init() and quit() before it starts and after it's joined
 CHIP8 chip8(currentPath);
-int currentBreakPoint = 0;
-
-int cyclesPerFrame = 5;
-bool running, halted, step;
-
+int currentBreakPoint = 0; // None (bp 0), a ROM never runs there
+
+unsigned long long speed = 500; // Instructions per second, 0 stops the machine
+CHIP8Scheduler scheduler(speed);
+bool halted, step;
+bool rewinding = false; // Backspace held: one recorded frame back per frame
+array<unsigned long long, 32> rowGenerations{}; // Display generation of the last change of each row
+
+// Input movie: while playing, the keyboard and the GUI's timer ticks are replaced by the recording
+enum class movieMode { none, recording, playing };
+CHIP8Movie movie;
+movieMode movieState = movieMode::none;
+string moviePath;
+
+// What the GUI shows, published by the emulation thread after every frame
+struct frame
+{
+	CHIP8::state machine;
+	string registers;
+	array<unsigned long long, 32> rowGenerations;
+	unsigned long long speed;
+	bool throttled;
+	bool halted;
+	bool waiting; // Halted, paused or blocked on a key: only a command or input changes the display
+};
+TripleBuffer<frame> frames;
+SpscQueue<string, 256> consoleMessages; // Console output of the emulation thread, see report()
+SpscQueue<function<void()>, 256> commands; // Run by the emulation thread in order, before its next frame
+thread emulator;
+atomic<bool> emulating;
+
+// Keyboard: CHIP-8 key k is keymap[k]. The GUI thread samples the keys once per frame,
+// the emulation thread places every change at the instruction it came at
+const int keymap[16] = { SDLK_x, SDLK_1, SDLK_2, SDLK_3, SDLK_q, SDLK_w, SDLK_e, SDLK_a,
+	SDLK_s, SDLK_d, SDLK_z, SDLK_c, SDLK_4, SDLK_r, SDLK_f, SDLK_v };
+struct keyEdge
+{
+	unsigned long long time; // SDL_GetTicks() of the event, then the instruction of the frame it comes before
+	CHIP8::byte key;
+	bool down;
+};
+atomic<uint16_t> keyMask{ 0 }; // Held keys, bit k is key k
+SpscQueue<keyEdge, 64> keyEdges;
+vector<keyEdge> frameEdges; // Emulation thread: the edges of this frame, in order
+size_t nextEdge;
+uint16_t appliedKeys = 0;
+Uint32 frameTicks; // Start of the previous frame
+
+bool running;
 bool debugMode = false;
 bool p_open = true;
 bool doResize = true;
@@ -114,12 +179,29 @@ int firstResizeCnt = 0; // It's really needed
 long msOnFrame;
 chrono::time_point<chrono::steady_clock> frameBegin, frameEnd;
 
+// Redrawing only when something can have changed, the window waits for events otherwise
+int pendingFrames = SETTLE_FRAMES; // Drawn whatever the machine does
+frame drawn; // The frame drawn last
+Uint32 drawnTicks = 0;
+
 int  init(int argc, char** argv);
-void events();
+bool events(); // False if there were none
+bool needsDrawing();
 void reload(string newPath);
 void showAboutWindow(bool* p_open);
 void resize();
 void quit();
+void keyEvent(int key, bool down, Uint32 time);
+void playMovie(unsigned long long cycles);
+void endMovie();
+
+void emulate(); // Emulation thread
+void emulateFrame();
+void takeKeyEdges(unsigned long long count);
+void applyKeyEdges(unsigned long long cycle);
+void publishFrame();
+void post(function<void()> command); // Runs command on the emulation thread
+void report(string const& text); // Console output from the emulation thread
 
 int main(int argc, char** argv)
 {
@@ -130,49 +212,36 @@ int main(int argc, char** argv)
 	p_open = true;
 	halted = debugMode;
 	step = false;
+	publishFrame();
+	frameTicks = SDL_GetTicks();
+	emulating = true;
+	emulator = thread(emulate);
 	logger::info("Getting into app's loop!");
 	while (running)
 	{
 		frameBegin = std::chrono::high_resolution_clock::now();
 
-		if(halted || cyclesPerFrame == 0 || chip8.delayTimer > 0) events();
-
-		if (chip8.delayTimer == 0)
+		if (events()) pendingFrames = SETTLE_FRAMES;
+		frames.update();
+		string text;
+		while (consoleMessages.pop(text))
 		{
-			if (!halted) for (int i = 0; i < cyclesPerFrame; i++)
-			{
-				events();
-				chip8.emulateCycle();
-				if (chip8.getPC() == currentBreakPoint)
-				{
-					logger::info("At breakpoint");
-					consoleItems.push_back(_strdup("At breakpoint"));
-					halted = true;
-				}
-				chip8.lastKey = -1;
-			}
-			if (chip8.caughtEndlessLoop()) halted = true;
-			if (step)
-			{
-				chip8.emulateCycle();
-				if (chip8.getPC() == currentBreakPoint)
-				{
-					logger::info("At breakpoint");
-					consoleItems.push_back(_strdup("At breakpoint"));
-				}
-				step = false;
-			}
+			addTextToLog(text);
+			scrollToBottom = true;
+			pendingFrames = max(pendingFrames, 1);
 		}
-		else 
-		{
-			chip8.delayTimer--;
-		}
-
-		if (chip8.soundTimer > 0)
+		if (!needsDrawing())
 		{
-			// TODO: play sound
-			chip8.soundTimer--;
+			// Halted, waiting for a key, hidden or showing the same display: sleep until input
+			// or the next frame of the machine, instead of rebuilding the same picture. A waiting
+			// machine only changes its timers, which the status shows every STATUS_MS
+			bool hidden = (SDL_GetWindowFlags(window) & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED)) != 0;
+			SDL_WaitEventTimeout(NULL, hidden ? HIDDEN_WAIT_MS : frames.read().waiting ? STATUS_MS : MS_PER_FRAME);
+			continue;
 		}
+		if (pendingFrames > 0) pendingFrames--;
+		drawn = frames.read();
+		drawnTicks = SDL_GetTicks();
 
 		ImGui_ImplSDLRenderer_NewFrame();
 		ImGui_ImplSDL2_NewFrame();
@@ -217,6 +286,173 @@ int main(int argc, char** argv)
 	quit();
 }
 
+void emulate()
+{
+	// Own clock: a slow GUI frame doesn't slow the machine down, a long machine frame doesn't freeze the GUI
+	auto next = chrono::steady_clock::now();
+	function<void()> command;
+	while (emulating)
+	{
+		bool idle = halted && !rewinding; // Nothing changes the machine but a command
+		while (commands.pop(command))
+		{
+			command();
+			idle = false;
+		}
+		emulateFrame();
+
+		auto now = chrono::steady_clock::now();
+		if (!scheduler.isThrottled() && !halted && !rewinding && speed != 0)
+		{
+			// Unthrottled: frames back to back, the GUI still gets one every MS_PER_FRAME
+			if (now < next) continue;
+			publishFrame();
+			next = now + chrono::milliseconds(MS_PER_FRAME);
+			continue;
+		}
+		if (!idle) publishFrame();
+
+		next += chrono::milliseconds(MS_PER_FRAME);
+		if (next < now) next = now; // Fell behind, frames aren't made up in a burst
+		else this_thread::sleep_until(next);
+	}
+}
+
+void emulateFrame()
+{
+	// Emulated time runs at speed, the timers tick at 60 Hz of it (see CHIP8Scheduler)
+	unsigned long long count = scheduler.due(CHIP8Scheduler::clock::now());
+	if (halted || rewinding || speed == 0) count = 0;
+	takeKeyEdges(count);
+
+	if (rewinding)
+	{
+		chip8.rewind(1);
+	}
+	else if (movieState == movieMode::playing)
+	{
+		// The movie brings the timer ticks of the run it recorded
+		playMovie(count);
+		if (step)
+		{
+			playMovie(1);
+			step = false;
+		}
+	}
+	else
+	{
+		// The machine runs up to the next key edge in one call, the scheduler splits it at the
+		// timer ticks. The instruction an edge lands on runs alone, it's the only one that sees
+		// the key as the last one pressed. A breakpoint needs pc after every instruction
+		bool stepping = currentBreakPoint != 0;
+		for (unsigned long long i = 0; i < count;)
+		{
+			size_t edges = nextEdge;
+			applyKeyEdges(i);
+			bool edge = nextEdge != edges;
+			unsigned long long n = count - i;
+			if (nextEdge < frameEdges.size()) n = min(n, frameEdges[nextEdge].time - i);
+			if (edge) n = 1;
+			else if (stepping)
+			{
+				// An idle loop can't end before the next tick or key, so it is run (and skipped) in one go
+				CHIP8::idle_loop loop = chip8.idleLoop();
+				unsigned long long cycles = chip8.getCycles();
+				if (loop.what == CHIP8::idle_loop::NONE || (currentBreakPoint >= loop.start && currentBreakPoint <= loop.end)) n = 1;
+				else n = min(n, scheduler.nextTick(cycles) - cycles);
+			}
+			i += max(scheduler.run(chip8, n), 1ULL);
+			if (edge) chip8.clearLastKey();
+			if (chip8.caughtEndlessLoop())
+			{
+				halted = true;
+				break;
+			}
+			if (chip8.getPC() == currentBreakPoint)
+			{
+				report("At breakpoint");
+				halted = true;
+				break;
+			}
+		}
+		if (step)
+		{
+			scheduler.run(chip8, 1);
+			if (chip8.getPC() == currentBreakPoint) report("At breakpoint");
+			step = false;
+		}
+	}
+
+	applyKeyEdges(ULLONG_MAX);
+	if (!halted && !rewinding) chip8.recordFrame();
+	chip8.endFrame();
+}
+
+// The edges that came during the last frame, spread over this one as far apart as they came
+void takeKeyEdges(unsigned long long count)
+{
+	Uint32 now = SDL_GetTicks();
+	Uint32 length = max<Uint32>(now - frameTicks, 1);
+	frameEdges.clear();
+	nextEdge = 0;
+	uint16_t keys = appliedKeys;
+	keyEdge edge;
+	while (keyEdges.pop(edge))
+	{
+		Uint32 since = (int32_t)((Uint32)edge.time - frameTicks) > 0 ? min((Uint32)edge.time - frameTicks, length - 1) : 0;
+		edge.time = since * count / length;
+		frameEdges.push_back(edge);
+		keys = edge.down ? keys | 1 << edge.key : keys & ~(1 << edge.key);
+	}
+
+	// Edges the queue had no room for, or pushed after the loop above: the held keys win
+	uint16_t missed = keyMask.load(memory_order_relaxed) ^ keys;
+	unsigned long long last = frameEdges.empty() ? 0 : frameEdges.back().time;
+	for (int key = 0; key < 16; key++)
+		if (missed >> key & 1) frameEdges.push_back({ last, (CHIP8::byte)key, !(keys >> key & 1) });
+	frameTicks = now;
+}
+
+void applyKeyEdges(unsigned long long cycle)
+{
+	for (; nextEdge < frameEdges.size() && frameEdges[nextEdge].time <= cycle; nextEdge++)
+	{
+		keyEdge const& edge = frameEdges[nextEdge];
+		if (((appliedKeys >> edge.key & 1) != 0) == edge.down) continue; // Already applied from keyMask
+		appliedKeys ^= 1 << edge.key;
+		if (movieState == movieMode::playing) continue;
+		if (edge.down) chip8.setKey(edge.key);
+		else chip8.unsetKey(edge.key);
+	}
+}
+
+void publishFrame()
+{
+	uint32_t rows = chip8.takeDirtyRows();
+	for (int y = 0; y < 32; y++)
+		if (rows >> y & 1) rowGenerations[y] = chip8.getDisplayGeneration();
+
+	frame& f = frames.write();
+	chip8.saveState(f.machine);
+	f.registers = chip8.regInfo();
+	f.rowGenerations = rowGenerations;
+	f.speed = speed;
+	f.throttled = scheduler.isThrottled();
+	f.halted = halted;
+	f.waiting = ((halted || speed == 0) && !rewinding) || chip8.idleLoop().what == CHIP8::idle_loop::KEY;
+	frames.publish();
+}
+
+void post(function<void()> command)
+{
+	if (!commands.push(move(command))) addTextToLog("ERROR: Emulation isn't responding, command dropped");
+}
+
+void report(string const& text)
+{
+	consoleMessages.push(text); // Dropped if the GUI is that far behind
+}
+
 int init(int argc, char** argv)
 {
 	vector<string> args;
@@ -230,7 +466,8 @@ int init(int argc, char** argv)
 		cout << "Usage: " << endl
 			<< "  -h [ --help ]                         shows this message" << endl
 			<< "  -d [ --debug ]                        debug mode on" << endl
-			<< "  -p [ --path ] file (=chip8start.ch8)  path to ROM" << endl;
+			<< "  -p [ --path ] file (=chip8start.ch8)  path to ROM" << endl
+			<< "  -s [ --seed ] N (=current time)       seed of the random number generator" << endl;
 		exit(0);
 	}
 	if (find(args.begin(), args.end(), "-d") != args.end() || find(args.begin(), args.end(), "--debug") != args.end()) debugMode = true;
@@ -246,6 +483,24 @@ int init(int argc, char** argv)
 		currentPath = *(it2 + 1);
 	}
 
+	uint64_t seed = chrono::system_clock::now().time_since_epoch().count();
+	auto it3 = find(args.begin(), args.end(), "-s");
+	if (it3 == args.end()) it3 = find(args.begin(), args.end(), "--seed");
+	if (it3 != args.end() && it3 + 1 != args.end())
+	{
+		try
+		{
+			seed = stoull(*(it3 + 1));
+		}
+		catch (logic_error const& e)
+		{
+			cout << "ERROR: Got invalid seed" << endl;
+			exit(1);
+		}
+	}
+	chip8.setSeed(seed);
+	chip8.setCheckpointInterval(CHECKPOINT_INTERVAL);
+
 	logFile.open(logger::generateName("logs/chip8emu-gui"), ios::out);
 	logger::addSink(&cout);
 	logger::addSink(&logFile);
@@ -304,7 +559,8 @@ int init(int argc, char** argv)
 	io.Fonts->AddFontFromFileTTF(FONT_ICON_FILE_NAME_FA, 13.0f, &icons_config, icons_ranges);
 
 	logger::debug("Loading CHIP-8...");
-	chip8.logCallback = addTextToLog;
+	chip8.logCallback = report;
+	logger::info("Random seed: " + to_string(chip8.getSeed()));
 	if (currentPath != START_ROM)
 	{
 		chip8.reload(currentPath);
@@ -313,12 +569,28 @@ int init(int argc, char** argv)
 	return 0;
 }
 
-void events()
+bool needsDrawing()
+{
+	if (SDL_GetWindowFlags(window) & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED)) return false;
+	if (pendingFrames > 0) return true;
+
+	frame const& shown = frames.read();
+	if (shown.rowGenerations != drawn.rowGenerations || shown.halted != drawn.halted
+		|| shown.speed != drawn.speed || shown.throttled != drawn.throttled)
+		return true;
+	// A machine waiting for a key or halted doesn't change these either
+	bool status = shown.registers != drawn.registers || shown.machine.ram != drawn.machine.ram;
+	return status && SDL_GetTicks() - drawnTicks >= STATUS_MS;
+}
+
+bool events()
 {
 	SDL_Event event;
 	ImGuiIO& io = ImGui::GetIO();
+	bool any = false;
 	while (SDL_PollEvent(&event))
 	{
+		any = true;
 		ImGui_ImplSDL2_ProcessEvent(&event);
 		if (event.type == SDL_QUIT)
 			running = false;
@@ -328,68 +600,29 @@ void events()
 		if (event.type == SDL_WINDOWEVENT && event.window.windowID == SDL_GetWindowID(window) 
 			&& event.window.event == SDL_WINDOWEVENT_RESIZED)
 			doResize = true;
+		if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+		{
+			for (int key = 0; key < 16; key++)
+				if (keymap[key] == event.key.keysym.sym) keyEvent(key, event.type == SDL_KEYDOWN, event.key.timestamp);
+		}
+
 		if (event.type == SDL_KEYDOWN)
 		{
 			switch (event.key.keysym.sym)
 			{
-			case SDLK_v:
-				chip8.setKey(0xf);
-				break;
-			case SDLK_c:
-				chip8.setKey(0xB);
-				break;
-			case SDLK_x:
-				chip8.setKey(0x0);
-				break;
-			case SDLK_z:
-				chip8.setKey(0xa);
-				break;
-			case SDLK_f:
-				chip8.setKey(0xe);
-				break;
-			case SDLK_d:
-				chip8.setKey(0x9);
-				break;
-			case SDLK_s:
-				chip8.setKey(0x8);
-				break;
-			case SDLK_a:
-				chip8.setKey(0x7);
-				break;
-			case SDLK_r:
-				chip8.setKey(0xd);
-				break;
-			case SDLK_e:
-				chip8.setKey(0x6);
-				break;
-			case SDLK_w:
-				chip8.setKey(0x5);
-				break;
-			case SDLK_q:
-				chip8.setKey(0x4);
-				break;
-			case SDLK_4:
-				chip8.setKey(0xc);
-				break;
-			case SDLK_3:
-				chip8.setKey(0x3);
-				break;
-			case SDLK_2:
-				chip8.setKey(0x2);
-				break;
-			case SDLK_1:
-				chip8.setKey(0x1);
-				break;
-
 			case SDLK_RETURN:
 				if (!io.WantCaptureKeyboard)
-					step = true;
+					post([] { step = true; });
 				break;
 			case SDLK_ESCAPE:
 			case SDLK_SPACE:
 				if(!io.WantCaptureKeyboard)
 					executeCommand("stop");
 				break;
+			case SDLK_BACKSPACE:
+				if (!io.WantCaptureKeyboard)
+					post([] { rewinding = movieState == movieMode::none; });
+				break;
 			}
 		}
 
@@ -397,57 +630,13 @@ void events()
 		{
 			switch (event.key.keysym.sym)
 			{
-			case SDLK_v:
-				chip8.unsetKey(0xf);
-				break;
-			case SDLK_c:
-				chip8.unsetKey(0xB);
-				break;
-			case SDLK_x:
-				chip8.unsetKey(0x0);
-				break;
-			case SDLK_z:
-				chip8.unsetKey(0xa);
-				break;
-			case SDLK_f:
-				chip8.unsetKey(0xe);
-				break;
-			case SDLK_d:
-				chip8.unsetKey(0x9);
-				break;
-			case SDLK_s:
-				chip8.unsetKey(0x8);
-				break;
-			case SDLK_a:
-				chip8.unsetKey(0x7);
-				break;
-			case SDLK_r:
-				chip8.unsetKey(0xd);
-				break;
-			case SDLK_e:
-				chip8.unsetKey(0x6);
-				break;
-			case SDLK_w:
-				chip8.unsetKey(0x5);
-				break;
-			case SDLK_q:
-				chip8.unsetKey(0x4);
-				break;
-			case SDLK_4:
-				chip8.unsetKey(0xc);
-				break;
-			case SDLK_3:
-				chip8.unsetKey(0x3);
-				break;
-			case SDLK_2:
-				chip8.unsetKey(0x2);
-				break;
-			case SDLK_1:
-				chip8.unsetKey(0x1);
+			case SDLK_BACKSPACE:
+				post([] { rewinding = false; });
 				break;
 			}
 		}
 	}
+	return any;
 }
 
 void drawMenu()
@@ -487,18 +676,37 @@ void drawMenu()
 	ImGui::Checkbox("Filled style", &filledStyle);
 	ImGui::SetCursorPosY(5);
 	ImGui::Checkbox("Invert colors", &colorsInverted);
+	ImGui::SetCursorPosY(5);
+	bool unthrottled = !frames.read().throttled;
+	if (ImGui::Checkbox("Unthrottled", &unthrottled))
+		post([unthrottled] { scheduler.setThrottled(!unthrottled); });
 	
-	string cyclesStr = (cyclesPerFrame == 0 ? "  " : "") + to_string(cyclesPerFrame * (1000 / MS_PER_FRAME)) + " cycles/sec";
+	unsigned long long shownSpeed = frames.read().speed;
+	string cyclesStr = (shownSpeed == 0 ? "  " : "") + to_string(shownSpeed) + " cycles/sec";
 	auto windowWidth = ImGui::GetWindowSize().x;
 	auto textWidth = ImGui::CalcTextSize(cyclesStr.c_str()).x;
 	ImGui::SetCursorPosX(windowWidth - textWidth - 15*2 - 25);
 	ImGui::SetCursorPosY(5);
-	if (ImGui::Button("+", ImVec2(15, 15))) cyclesPerFrame++;
+	if (ImGui::Button("+", ImVec2(15, 15)))
+	{
+		post([]
+		{
+			speed += SPEED_STEP;
+			scheduler.setSpeed(speed);
+		});
+	}
 	ImGui::SameLine();
 	ImGui::Text(cyclesStr.c_str());
 	ImGui::SameLine();
 	ImGui::SetCursorPosY(5);
-	if (ImGui::Button("-", ImVec2(15, 15))) (cyclesPerFrame == 0 ? 0 : cyclesPerFrame--);
+	if (ImGui::Button("-", ImVec2(15, 15)))
+	{
+		post([]
+		{
+			if (speed >= SPEED_STEP) speed -= SPEED_STEP;
+			if (speed > 0) scheduler.setSpeed(speed);
+		});
+	}
 	ImGui::PopStyleVar();
 	ImGui::EndMainMenuBar();
 	ImGui::PopStyleVar();
@@ -524,16 +732,72 @@ void drawDisplay()
 	draw_list->AddRectFilled(mainRect1, mainRect2, (colorsInverted ? WHITE : BLACK));
 	draw_list->AddRect(mainRect1, mainRect2, IM_COL32(128, 128, 128, 255));
 
-	// Drawing pixels
-	for (int i = 0; i < 32; i++) {
-		for (int j = 0; j < 64; j++) {
-			draw_list->AddRectFilled({ mainRect1.x + 1 + j * rectWidth, mainRect1.y + 1 + i * rectHeight },
-				{ mainRect1.x + filledStyle + j * rectWidth + rectWidth, mainRect1.y + filledStyle + i * rectHeight + rectHeight },
-				chip8.display(j, i) ? (colorsInverted ? BLACK : WHITE) : (colorsInverted ? WHITE : BLACK));
+	updateDisplayTexture();
+	if (displayTexture != NULL)
+		draw_list->AddImage((ImTextureID)displayTexture, { mainRect1.x + 1, mainRect1.y + 1 },
+			{ mainRect1.x + 1 + 64 * rectWidth, mainRect1.y + 1 + 32 * rectHeight });
+
+	ImGui::EndChild();
+}
+
+void updateDisplayTexture()
+{
+	int width = max(1, (int)rectWidth);
+	int height = max(1, (int)rectHeight);
+	if (displayTexture == NULL || width != cellWidth || height != cellHeight)
+	{
+		if (displayTexture != NULL) SDL_DestroyTexture(displayTexture);
+		cellWidth = width;
+		cellHeight = height;
+		displayTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, 64 * cellWidth, 32 * cellHeight);
+		if (displayTexture == NULL)
+		{
+			logger::error("Can`t create display texture: " + string(SDL_GetError()));
+			return;
 		}
+		SDL_SetTextureScaleMode(displayTexture, SDL_ScaleModeNearest);
+		displayPixels.resize(64 * cellWidth * 32 * cellHeight);
+		displayTextureValid = false;
 	}
 
-	ImGui::EndChild();
+	frame const& shown = frames.read();
+	uint32_t rows = 0;
+	for (int i = 0; i < 32; i++)
+		if (shown.rowGenerations[i] != shownGenerations[i]) rows |= 1u << i;
+	shownGenerations = shown.rowGenerations;
+	if (!displayTextureValid || shownFilled != filledStyle || shownInverted != colorsInverted) rows = 0xFFFFFFFF;
+	if (rows == 0) return;
+
+	uint32_t on = colorsInverted ? BLACK : WHITE;
+	uint32_t off = colorsInverted ? WHITE : BLACK;
+	bool gaps = !filledStyle && cellWidth > 1 && cellHeight > 1; // Outline style: the last texel column and row of a cell stay off
+	int pitch = 64 * cellWidth;
+	int first = 32, last = 0;
+	for (int i = 0; i < 32; i++)
+	{
+		if (!(rows >> i & 1)) continue;
+		first = min(first, i);
+		last = i;
+		uint64_t row = shown.machine.graphicsMap[i];
+		uint32_t* line = &displayPixels[i * cellHeight * pitch];
+		for (int j = 0; j < 64; j++)
+		{
+			uint32_t color = (row >> (63 - j) & 1) ? on : off;
+			for (int k = 0; k < cellWidth; k++)
+				line[j * cellWidth + k] = (gaps && k == cellWidth - 1) ? off : color;
+		}
+		for (int k = 1; k < cellHeight; k++)
+		{
+			if (gaps && k == cellHeight - 1) fill(line + k * pitch, line + (k + 1) * pitch, off);
+			else copy(line, line + pitch, line + k * pitch);
+		}
+	}
+	// One upload from the first to the last changed row
+	SDL_Rect area = { 0, first * cellHeight, pitch, (last - first + 1) * cellHeight };
+	SDL_UpdateTexture(displayTexture, &area, &displayPixels[first * cellHeight * pitch], pitch * sizeof(uint32_t));
+	shownFilled = filledStyle;
+	shownInverted = colorsInverted;
+	displayTextureValid = true;
 }
 
 void drawCodeWindow()
@@ -545,7 +809,8 @@ void drawCodeWindow()
 	
 	ImGui::BeginChild("ScrollingRegionCode");
 
-	int pc = chip8.getPC();
+	frame const& shown = frames.read();
+	int pc = shown.machine.pc;
 	static int range1 = 0x200 - 10;
 	static int range2 = range1 + 42;
 	if (pc+2 > range2 || pc - 2 < range1)
@@ -559,27 +824,29 @@ void drawCodeWindow()
 
 	for (CHIP8::dbyte i = range1; i < range2; i += 2)
 	{
-		string code = CHIP8::disasmCode(chip8.getFromRam(i) * 0x100 + chip8.getFromRam(i + 1));
-		string fstr = type_to_hex(i) + ": ";
+		// Formatted once for all opcodes, nothing is allocated per frame
+		CHIP8::dbyte opcode = shown.machine.ram[i & 0xFFF] << 8 | shown.machine.ram[(i + 1) & 0xFFF];
+		char const* code = isa::text(opcode);
+		isa::kind what = isa::find(opcode).what;
 		bool hasColorYellow = (i == pc);
-		bool hasColorBlue = (code.rfind("jmp", 0) == 0 || code.rfind("call", 0) == 0) && !hasColorYellow;
-		bool hasColorRed = (code.rfind("ret", 0) == 0) && !hasColorYellow;
-		bool hasColorGreen = (code.rfind("drw", 0) == 0) && !hasColorYellow;
+		bool hasColorBlue = (what == isa::JUMP || what == isa::JUMP_V0 || what == isa::CALL) && !hasColorYellow;
+		bool hasColorRed = (what == isa::RET) && !hasColorYellow;
+		bool hasColorGreen = (what == isa::DRAW) && !hasColorYellow;
 		ImVec2 old = ImGui::GetCursorPos();
-		if (code == "ret")
+		if (what == isa::RET)
 		{
 			ImVec2 n(old.x, old.y + 3);
 			ImGui::SetCursorPos(n);
 			ImGui::TextUnformatted(string(23, '_').c_str());
 			ImGui::SetCursorPos(old);
 		}
-		ImGui::TextUnformatted(fstr.c_str());
+		ImGui::Text("0x%04x: ", i);
 		if (hasColorYellow) ImGui::PushStyleColor(ImGuiCol_Text, YELLOW);
 		if (hasColorBlue) ImGui::PushStyleColor(ImGuiCol_Text, BLUE);
 		if (hasColorRed) ImGui::PushStyleColor(ImGuiCol_Text, RED);
 		if (hasColorGreen) ImGui::PushStyleColor(ImGuiCol_Text, GREEN);
 		ImGui::SameLine();
-		ImGui::TextUnformatted(code.c_str());
+		ImGui::TextUnformatted(code);
 		if (hasColorYellow)
 		{
 			ImGui::SameLine();
@@ -696,8 +963,8 @@ void drawStatusWindow()
 	ImGui::BeginMenuBar();
 	TextCentered("CPU STATE");
 	ImGui::EndMenuBar();
-	ImGui::Text(chip8.regInfo().c_str());
-	if (halted) ImGui::Text("\n--- STOPPED ---");
+	ImGui::Text(frames.read().registers.c_str());
+	if (frames.read().halted) ImGui::Text("\n--- STOPPED ---");
 	ImGui::EndChild();
 }
 
@@ -706,8 +973,12 @@ void reload(string newPath)
 	currentPath = newPath;
 	windowName = "CHIP-8 emulator: " + currentPath;
 	SDL_SetWindowTitle(window, windowName.c_str());
-	chip8.reload(newPath);
-	halted = false;
+	post([newPath]
+	{
+		endMovie();
+		chip8.reload(newPath);
+		halted = false;
+	});
 	clearConsole();
 }
 
@@ -777,57 +1048,64 @@ void executeCommand(const char* cmd)
 	else if (TEXT_CMP3(cmd, r, reg, info))
 	{
 		logger::info("Got info command");
-		consoleItems.push_back(_strdup(chip8.regInfo().c_str()));
+		post([] { report(chip8.regInfo()); });
 	}
 	else if (TEXT_CMP2(cmd, c, continue))
 	{
 		logger::info("Got continue command");
 		consoleItems.push_back(_strdup("Continuing..."));
-		halted = false;
+		post([] { halted = false; });
 	}
 	else if (TEXT_CMP2(cmd, b, begin))
 	{
 		logger::info("Got begin command");
-		chip8.reload(currentPath);
-		consoleItems.push_back(_strdup("At PC = 0x200"));
-		halted = true;
+		post([path = currentPath]
+		{
+			endMovie();
+			chip8.reload(path);
+			report("At PC = 0x200");
+			halted = true;
+		});
 	}
 	else if (TEXT_CMP1(cmd, bnc))
 	{
 		logger::info("Got begin and continue command");
-		chip8.refresh();
 		consoleItems.push_back(_strdup("Continuing from the begining..."));
-		halted = false;
+		post([]
+		{
+			endMovie();
+			chip8.refresh();
+			halted = false;
+		});
 	}
 	else if (TEXT_CMP2(cmd, s, step))
 	{
 		logger::info("Got step command");
-		step = true;
-		chip8.resetEndlessLoop();
 		consoleItems.push_back(_strdup("Step"));
+		post([]
+		{
+			step = true;
+			if (movieState != movieMode::playing) chip8.resetEndlessLoop();
+		});
 	}
 	else if (TEXT_CMP1(cmd, stop))
 	{
 		logger::info("Got stop command");
-		if (!halted)
+		post([]
 		{
-			halted = true;
-			consoleItems.push_back(_strdup("Stopped"));
-		}
-		else
-		{
-			halted = false;
-			consoleItems.push_back(_strdup("Unstopped"));
-		}
+			halted = !halted;
+			report(halted ? "Stopped" : "Unstopped");
+		});
 	}
 	else if (!strncmp(cmd, "bp", 2) || !strncmp(cmd, "breakpoint", 10))
 	{
 		logger::info("Got breakpoint command");
+		int address;
 		if (cmd[0] == 'b' && cmd[1] == 'p')
 		{
 			try
 			{
-				currentBreakPoint = stoi(string(cmd).substr(2, strlen(cmd)), nullptr, 0);
+				address = stoi(string(cmd).substr(2, strlen(cmd)), nullptr, 0);
 			}
 			catch (invalid_argument const& e)
 			{
@@ -840,7 +1118,7 @@ void executeCommand(const char* cmd)
 		{
 			try
 			{
-				currentBreakPoint = stoi(string(cmd).substr(10, strlen(cmd)), nullptr, 0);
+				address = stoi(string(cmd).substr(10, strlen(cmd)), nullptr, 0);
 			}
 			catch (invalid_argument const& e)
 			{
@@ -849,14 +1127,127 @@ void executeCommand(const char* cmd)
 				return;
 			}
 		}
+		post([address] { currentBreakPoint = address; });
+	}
+	else if (!strncmp(cmd, "sb", 2) || !strncmp(cmd, "stepback", 8))
+	{
+		logger::info("Got stepback command");
+		unsigned long long count = 1;
+		string arg = string(cmd).substr(cmd[1] == 'b' ? 2 : 8);
+		if (arg.find_first_not_of(' ') != string::npos)
+		{
+			try
+			{
+				count = stoull(arg, nullptr, 0);
+			}
+			catch (logic_error const& e)
+			{
+				logger::error("Got invalid argument");
+				consoleItems.push_back(_strdup("ERROR: Got invalid argument"));
+				return;
+			}
+		}
+		post([count]
+		{
+			if (movieState != movieMode::none)
+			{
+				report("ERROR: Not while a movie is active, use endmovie");
+				return;
+			}
+			halted = true;
+			if (!chip8.stepBack(count))
+			{
+				report("ERROR: Not that far back in the recording");
+				return;
+			}
+			report("At PC = " + type_to_hex(chip8.getPC()) + ", cycle " + to_string(chip8.getCycles()));
+		});
+	}
+	else if (TEXT_CMP2(cmd, rc, reverse-continue))
+	{
+		logger::info("Got reverse-continue command");
+		post([]
+		{
+			if (movieState != movieMode::none)
+			{
+				report("ERROR: Not while a movie is active, use endmovie");
+				return;
+			}
+			halted = true;
+			if (chip8.reverseContinue(currentBreakPoint))
+				report("At breakpoint, cycle " + to_string(chip8.getCycles()));
+			else
+				report("At the beginning of the recording");
+		});
+	}
+	else if (!strncmp(cmd, "checkpoint", 10))
+	{
+		logger::info("Got checkpoint command");
+		unsigned long long interval;
+		try
+		{
+			interval = stoull(string(cmd).substr(10, strlen(cmd)), nullptr, 0);
+		}
+		catch (logic_error const& e)
+		{
+			logger::error("Got invalid argument");
+			consoleItems.push_back(_strdup("ERROR: Got invalid argument"));
+			return;
+		}
+		post([interval] { chip8.setCheckpointInterval(interval); });
+	}
+	else if (!strncmp(cmd, "record", 6) || !strncmp(cmd, "play", 4))
+	{
+		bool recording = cmd[0] == 'r';
+		logger::info(recording ? "Got record command" : "Got play command");
+		string path = string(cmd).substr(recording ? 6 : 4);
+		path.erase(0, path.find_first_not_of(' '));
+		if (path.empty())
+		{
+			logger::error("No file specified");
+			consoleItems.push_back(_strdup("ERROR: No file specified"));
+			return;
+		}
+
+		CHIP8Movie newMovie;
+		if (!recording && !newMovie.load(path))
+		{
+			logger::error("Can't load movie " + path);
+			consoleItems.push_back(_strdup(("ERROR: Can't load movie " + path).c_str()));
+			return;
+		}
+		post([recording, path, newMovie, rom = currentPath]
+		{
+			// Movies start from a freshly loaded ROM
+			endMovie();
+			chip8.reload(rom);
+			movie = newMovie;
+			if (recording) movie.record(chip8);
+			else if (!movie.play(chip8))
+			{
+				report("ERROR: Movie was recorded with another ROM");
+				return;
+			}
+			moviePath = path;
+			movieState = recording ? movieMode::recording : movieMode::playing;
+			halted = false;
+			report((recording ? "Recording to " : "Playing ") + path);
+		});
+	}
+	else if (TEXT_CMP1(cmd, endmovie))
+	{
+		logger::info("Got endmovie command");
+		post([]
+		{
+			if (movieState == movieMode::none) report("ERROR: No movie is active");
+			endMovie();
+		});
 	}
 	else if (!strncmp(cmd, "dump", 4))
 	{
 		logger::info("Got dump command");
 
-		stringstream res;
 		int addr;
-		res << "Memory: " << endl;
 		try
 		{
 			addr = stoi(string(cmd).substr(4, strlen(cmd)), nullptr, 0);
@@ -867,12 +1258,16 @@ void executeCommand(const char* cmd)
 			consoleItems.push_back(_strdup("ERROR: Got invalid argument"));
 			return;
 		}
-		for (int i = 0; i < 5; i++)
+		post([addr]
 		{
-			res << "[" << hex << setw(4) << i + addr << "]: " << (unsigned) chip8.getFromRam(i + addr) << endl;
-		}
-
-		consoleItems.push_back(_strdup(res.str().c_str()));
+			stringstream res;
+			res << "Memory: " << endl;
+			for (int i = 0; i < 5; i++)
+			{
+				res << "[" << hex << setw(4) << i + addr << "]: " << (unsigned) chip8.getFromRam(i + addr) << endl;
+			}
+			report(res.str());
+		});
 	}
 	else
 	{
@@ -885,17 +1280,73 @@ void executeCommand(const char* cmd)
 
 void addTextToLog(string const& text)
 {
+	if (text.rfind("ERROR", 0) == 0) logger::error(text);
+	else logger::info(text);
 	consoleItems.push_back(_strdup(text.c_str()));
 }
 
+void keyEvent(int key, bool down, Uint32 time)
+{
+	// Only changes are sent, keyboard autorepeat doesn't press a key again
+	uint16_t held = keyMask.load(memory_order_relaxed);
+	if (((held >> key & 1) != 0) == down) return;
+	keyMask.store(held ^ 1 << key, memory_order_relaxed);
+	keyEdges.push({ time, (CHIP8::byte)key, down }); // If it's full, the emulation thread catches up from keyMask
+}
+
+// Same as the loop in emulateFrame(), with the inputs and the timer ticks coming from the movie
+void playMovie(unsigned long long cycles)
+{
+	bool stepping = currentBreakPoint != 0;
+	for (unsigned long long i = 0; i < cycles && movieState == movieMode::playing;)
+	{
+		if (movie.finished() && chip8.getCycles() >= movie.length())
+		{
+			report("Movie finished");
+			endMovie();
+			break;
+		}
+		unsigned long long n = stepping ? 1 : cycles - i;
+		if (chip8.getCycles() < movie.length()) n = min(n, movie.length() - chip8.getCycles());
+		unsigned long long done = movie.run(chip8, n);
+		if (done == 0) break;
+		i += done;
+		if (chip8.getPC() == currentBreakPoint)
+		{
+			report("At breakpoint");
+			halted = true;
+			break;
+		}
+	}
+	if (chip8.caughtEndlessLoop()) halted = true;
+}
+
+void endMovie()
+{
+	if (movieState == movieMode::none) return;
+	movie.stop(chip8);
+	if (movieState == movieMode::recording)
+	{
+		if (movie.save(moviePath)) report("Movie saved to " + moviePath);
+		else report("ERROR: Can't write movie " + moviePath);
+	}
+	movieState = movieMode::none;
+}
+
 void quit()
 {
 	logger::info("Quitting...");
+	emulating = false;
+	if (emulator.joinable()) emulator.join();
+	endMovie();
+	string text;
+	while (consoleMessages.pop(text)) addTextToLog(text);
 	clearConsole();
 	ImGui_ImplSDLRenderer_Shutdown();
 	ImGui_ImplSDL2_Shutdown();
 	ImGui::DestroyContext();
 
+	if (displayTexture != NULL) SDL_DestroyTexture(displayTexture);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
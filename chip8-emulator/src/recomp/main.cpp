@@ -0,0 +1,195 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// chip8-recomp - ahead-of-time recompiler. Finds the code reachable from 0x200
+// and writes a C++ file with one function per basic block. Compiled into a
+// program that links chip8-core, it's used by CHIP8::engine::aot
+
+#include "../common.h"
+#include "../chip8/aot.hpp"
+#include "../chip8/isa.hpp"
+
+#include <map>
+#include <set>
+
+#define ARGS_FIND(args, cmd) ((argIndex = find((args).begin(), (args).end(), cmd) - args.begin()) != (args).size())
+
+using namespace std;
+
+using block = vector<int>; // Instruction addresses
+
+// Instructions that stop the machine on a bad I
+bool canStop(isa::kind what)
+{
+	return what == isa::DRAW || what == isa::STORE || what == isa::LOAD;
+}
+
+// Control flow comes from the shared instruction table, so there's only one decoder.
+// Blocks end at jumps, calls, returns, skips, key waits, RAM writes and unknown opcodes
+map<int, block> discover(vector<CHIP8::byte> const& ram, int end)
+{
+	map<int, block> blocks;
+	vector<int> work = { 0x200 };
+	auto follow = [&](int addr) { if (addr >= 0x200 && addr + 1 < end && !blocks.count(addr)) work.push_back(addr); };
+
+	while (!work.empty())
+	{
+		int start = work.back();
+		work.pop_back();
+		if (blocks.count(start)) continue;
+
+		block& b = blocks[start];
+		int addr = start;
+		while (addr + 1 < end)
+		{
+			int code = ram[addr] << 8 | ram[addr + 1];
+			isa::kind what = isa::find(code).what;
+			if (what == isa::DATA) break; // Interpreted, may be data
+
+			b.push_back(addr);
+			int next = addr + 2;
+			bool ends = true;
+			switch (what)
+			{
+			case isa::JUMP:
+				follow(code & 0x0FFF);
+				break;
+			case isa::CALL:
+				follow(code & 0x0FFF);
+				follow(next);
+				break;
+			case isa::RET: case isa::JUMP_V0:
+				break;
+			case isa::SKIP:
+				follow(next);
+				follow(next + 2);
+				break;
+			case isa::KEY: case isa::STORE:
+				follow(next);
+				break;
+			default:
+				ends = false;
+				break;
+			}
+			if (ends) break;
+			addr = next;
+			if ((int)b.size() == CHIP8::aot::MAX_BLOCK)
+			{
+				follow(addr);
+				break;
+			}
+		}
+		if (b.empty()) blocks.erase(start);
+	}
+	return blocks;
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> args;
+	size_t argIndex; // Macros requirement
+	for (int i = 0; i < argc; i++)
+	{
+		args.push_back(argv[i]);
+	}
+
+	if (ARGS_FIND(args, "-h") || ARGS_FIND(args, "--help"))
+	{
+		cout << "Usage: " << endl
+			<< "  -h [ --help ]              shows this message" << endl
+			<< "  -p [ --path ] file         path to ROM" << endl
+			<< "  -o [ --output ] file       C++ file to write" << endl;
+		return 0;
+	}
+
+	bool pathFound = ARGS_FIND(args, "-p") || ARGS_FIND(args, "--path");
+	size_t pathIndex = argIndex + 1;
+	bool outputFound = ARGS_FIND(args, "-o") || ARGS_FIND(args, "--output");
+	size_t outputIndex = argIndex + 1;
+
+	if (!pathFound || pathIndex >= args.size() || !outputFound || outputIndex >= args.size())
+	{
+		cout << "ERROR: Specify ROM and output file" << endl;
+		return 1;
+	}
+
+	ifstream rom(args[pathIndex], ios::in | ios::binary);
+	vector<CHIP8::byte> bytes;
+	if (rom) bytes.assign(istreambuf_iterator<char>(rom), istreambuf_iterator<char>());
+	if (bytes.empty() || bytes.size() > 3584)
+	{
+		cout << "ERROR: Can't load ROM " << args[pathIndex] << endl;
+		return 1;
+	}
+
+	vector<CHIP8::byte> ram(4096, 0);
+	copy(bytes.begin(), bytes.end(), ram.begin() + 0x200);
+	int end = 0x200 + (int)bytes.size();
+	map<int, block> blocks = discover(ram, end);
+
+	ofstream out(args[outputIndex]);
+	if (!out)
+	{
+		cout << "ERROR: Can't write " << args[outputIndex] << endl;
+		return 1;
+	}
+
+	string name = args[pathIndex].substr(args[pathIndex].find_last_of("/\\") + 1);
+	out << "// Generated by chip8-recomp from " << name << ", don't edit." << endl
+		<< "// Compile into a program that links chip8-core and select CHIP8::engine::aot" << endl
+		<< endl
+		<< "#include \"chip8/aot.hpp\"" << endl
+		<< endl
+		<< "namespace" << endl
+		<< "{" << endl
+		<< "\tusing A = CHIP8::aot;" << endl;
+
+	for (auto const& [start, b] : blocks)
+	{
+		out << endl << "\tint b" << hex << start << "(CHIP8& c)" << endl << "\t{" << endl;
+		for (size_t i = 0; i < b.size(); i++)
+		{
+			int code = ram[b[i]] << 8 | ram[b[i] + 1];
+			string text = CHIP8::disasmCode(code);
+			out << "\t\tA::step<" << type_to_hex((CHIP8::dbyte)code) << ", " << type_to_hex((CHIP8::dbyte)b[i]) << ">(c); // " << text << endl;
+			if (canStop(isa::find(code).what) && i + 1 < b.size()) out << "\t\tif (A::stopped(c)) return " << dec << i + 1 << ";" << endl;
+		}
+		out << "\t\treturn " << dec << b.size() << ";" << endl << "\t}" << endl;
+	}
+
+	out << endl << "\tA::entry const entries[] =" << endl << "\t{" << endl;
+	for (auto const& [start, b] : blocks)
+		out << "\t\t{ " << type_to_hex((CHIP8::dbyte)start) << ", " << dec << b.size() << ", " << b.size() * 2 << ", b" << hex << start << " }," << endl;
+	out << "\t};" << endl
+		<< endl
+		<< "\tbool registered = A::add({ " << type_to_hex(CHIP8::aot::hash(bytes.data(), bytes.size())) << "ULL, " << dec << bytes.size()
+		<< ", entries, sizeof(entries) / sizeof(entries[0]) });" << endl
+		<< "}" << endl;
+
+	cout << "ROM:    " << args[pathIndex] << endl
+		<< "Blocks: " << blocks.size() << endl
+		<< "Output: " << args[outputIndex] << endl;
+	return 0;
+}
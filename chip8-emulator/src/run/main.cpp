@@ -0,0 +1,637 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// chip8-run - headless CHIP-8 runner. No window, no SDL, no ImGui:
+// loads a ROM, runs it for a fixed budget and prints the numbers.
+// With --batch runs a whole directory or manifest of ROMs on all cores.
+// With --golden writes a manifest that checks the display hashes and the speed of the run,
+// running that manifest later is the regression suite.
+
+#include "../common.h"
+#include "../chip8/CHIP8.hpp"
+#include "../chip8/movie.hpp"
+#include "../chip8/scheduler.hpp"
+#include "pool.hpp"
+
+#include <climits>
+#include <filesystem>
+
+#define ARGS_FIND(args, cmd) ((argIndex = find((args).begin(), (args).end(), cmd) - args.begin()) != (args).size())
+
+using namespace std;
+
+struct job
+{
+	string path;
+	unsigned long long cycles = 0, frames = 0; // One of them is set
+	int instructionsPerFrame = 10;
+	CHIP8::engine engine = CHIP8::engine::interpreter;
+	uint64_t seed = 0;
+	string play, record; // Input movies
+	unsigned long long checkpoint = 0; // Cycles between display hash samples, 0 samples only the end
+	vector<pair<unsigned long long, uint64_t>> checks; // Expected display hash at a cycle
+	double ips = 0; // Baseline speed, 0 doesn't check it
+	double tolerance = 25; // Percent below the baseline that still passes
+	bool detectLoops = false; // Stop at any endless loop, not only a jump to itself
+	bool fastForward = true; // Skip idle loops, see CHIP8::skipIdle()
+
+	unsigned long long budget() const { return cycles ? cycles : frames * instructionsPerFrame; }
+};
+
+struct result
+{
+	bool loaded = false;
+	uint64_t seed = 0; // A played movie brings its own
+	unsigned long long executed = 0;
+	double seconds = 0;
+	uint64_t hash = 0;
+	unsigned long long invalidated = 0;
+	unsigned long long idle = 0; // Instructions of idle loops skipped instead of executed
+
+	// Speed of the instructions actually executed, the skipped ones took no time
+	double ips() const { return seconds > 0 ? (executed - idle) / seconds : 0; }
+	bool stopped = false;
+	CHIP8::code_range loop = { 0, 0 }; // Where it stopped
+	vector<string> errors; // Reported by the core, without the "ERROR: " prefix
+	vector<pair<unsigned long long, uint64_t>> hashes; // Display hash samples, the last one is at the end
+	vector<string> failures; // Checks of the job that didn't pass
+};
+
+static char const* const engineNames[] = { "interpreter", "cached", "block", "jit", "aot" };
+
+static bool parseEngine(string const& name, CHIP8::engine& e)
+{
+	for (int i = 0; i < 5; i++)
+	{
+		if (name == engineNames[i])
+		{
+			e = (CHIP8::engine)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static result runJob(job const& j, bool quiet)
+{
+	result r;
+	CHIP8 chip8;
+	chip8.setEngine(j.engine);
+	chip8.setSeed(j.seed);
+	chip8.setLoopDetection(j.detectLoops);
+	chip8.logCallback = [&](string const& text)
+	{
+		if (text.compare(0, 7, "ERROR: ") == 0) r.errors.push_back(text.substr(7));
+		if (!quiet) cerr << text << endl;
+	};
+	if (!chip8.reload(j.path)) return r;
+	r.loaded = true;
+
+	// A movie has the timer ticks of the run it recorded, they aren't generated here
+	CHIP8Movie movie;
+	movie.setFastForward(j.fastForward);
+	bool playing = !j.play.empty();
+	if (playing && !movie.load(j.play))
+	{
+		chip8.logCallback("ERROR: Can't load movie " + j.play);
+		return r;
+	}
+	if (playing && !movie.play(chip8))
+	{
+		chip8.logCallback("ERROR: Movie " + j.play + " was recorded with another ROM");
+		return r;
+	}
+	if (!j.record.empty()) movie.record(chip8);
+	r.seed = chip8.getSeed();
+
+	// A frame is one timer period of emulated time, as fast as the host goes
+	CHIP8Scheduler scheduler(j.instructionsPerFrame * CHIP8Scheduler::TIMER_HZ);
+	scheduler.setThrottled(false);
+	scheduler.setFastForward(j.fastForward);
+
+	// Hashes are sampled between instructions, without splitting the frames the timers tick on
+	auto nextSample = [&](unsigned long long cycle)
+	{
+		unsigned long long next = j.checkpoint ? (cycle / j.checkpoint + 1) * j.checkpoint : ULLONG_MAX;
+		for (auto const& check : j.checks) if (check.first > cycle) next = min(next, check.first);
+		return next;
+	};
+	unsigned long long sampleAt = nextSample(0);
+	auto advance = [&](unsigned long long count)
+	{
+		unsigned long long executed = 0;
+		while (executed < count)
+		{
+			unsigned long long n = min(count - executed, sampleAt - chip8.getCycles());
+			unsigned long long done = playing ? movie.run(chip8, n) : scheduler.run(chip8, n);
+			executed += done;
+			if (chip8.getCycles() == sampleAt)
+			{
+				r.hashes.push_back({ sampleAt, chip8.displayHash() });
+				sampleAt = nextSample(sampleAt);
+			}
+			if (done < n) break;
+		}
+		return executed;
+	};
+
+	unsigned long long budget = j.budget() ? j.budget() : movie.length();
+	auto begin = chrono::steady_clock::now();
+	while (chip8.getCycles() < budget && !chip8.caughtEndlessLoop())
+	{
+		// A movie sends the inputs due at the cycle the machine stops at before returning, so
+		// a restart recorded there is already in; a stopped machine never reaches later ones
+		if (advance(budget - chip8.getCycles()) == 0) break;
+	}
+	auto end = chrono::steady_clock::now();
+
+	if (!j.record.empty())
+	{
+		movie.stop(chip8);
+		if (!movie.save(j.record)) chip8.logCallback("ERROR: Can't write movie " + j.record);
+	}
+
+	r.seconds = chrono::duration<double>(end - begin).count();
+	r.executed = chip8.getCycles();
+	r.hash = chip8.displayHash();
+	r.invalidated = chip8.getInvalidations();
+	r.idle = chip8.getIdleCycles();
+	r.stopped = chip8.caughtEndlessLoop();
+	r.loop = chip8.loopRange();
+	if (r.hashes.empty() || r.hashes.back().first != r.executed) r.hashes.push_back({ r.executed, r.hash });
+
+	for (auto const& check : j.checks)
+	{
+		auto sample = find_if(r.hashes.begin(), r.hashes.end(), [&](auto const& s) { return s.first == check.first; });
+		if (sample == r.hashes.end())
+			r.failures.push_back("Ran to cycle " + to_string(r.executed) + ", the check at cycle " + to_string(check.first) + " wasn't reached");
+		else if (sample->second != check.second)
+			r.failures.push_back("Display hash at cycle " + to_string(check.first) + " is " + type_to_hex(sample->second)
+				+ ", expected " + type_to_hex(check.second));
+	}
+	double ips = r.ips();
+	if (j.ips > 0 && ips < j.ips * (1 - j.tolerance / 100))
+	{
+		stringstream text;
+		text << fixed << setprecision(0) << "IPS " << ips << " is " << (1 - ips / j.ips) * 100
+			<< "% below the baseline " << j.ips << " (tolerance " << j.tolerance << "%)";
+		r.failures.push_back(text.str());
+	}
+	return r;
+}
+
+// A directory means every .ch8 file in it. Anything else is a manifest: a ROM path per line
+// (relative to the manifest), optionally followed by cycles=N, frames=N, ipf=N, seed=N, engine=name, movie=path
+// (an input movie to play, see movie.hpp), check=N:hash (the display hash after N instructions, can repeat)
+// or ips=N (the baseline speed). Empty lines and lines starting with # are skipped
+static bool loadJobs(string const& path, job const& defaults, vector<job>& jobs)
+{
+	namespace fs = std::filesystem;
+	error_code error;
+	if (fs::is_directory(path, error))
+	{
+		for (fs::directory_entry const& entry : fs::directory_iterator(path, error))
+		{
+			if (!entry.is_regular_file(error) || entry.path().extension() != ".ch8") continue;
+			job j = defaults;
+			j.path = entry.path().string();
+			jobs.push_back(j);
+		}
+		if (error)
+		{
+			cout << "ERROR: Can't read directory " << path << endl;
+			return false;
+		}
+		sort(jobs.begin(), jobs.end(), [](job const& a, job const& b) { return a.path < b.path; });
+		return true;
+	}
+
+	ifstream manifest(path);
+	if (!manifest)
+	{
+		cout << "ERROR: Can't open manifest " << path << endl;
+		return false;
+	}
+	fs::path base = fs::path(path).parent_path();
+	string line;
+	for (int lineNumber = 1; getline(manifest, line); lineNumber++)
+	{
+		stringstream tokens(line);
+		string token;
+		if (!(tokens >> token) || token[0] == '#') continue;
+
+		job j = defaults;
+		j.path = (base / token).string();
+		while (tokens >> token)
+		{
+			size_t eq = token.find('=');
+			string key = token.substr(0, eq);
+			string value = eq == string::npos ? "" : token.substr(eq + 1);
+			try
+			{
+				if (key == "cycles") j.cycles = stoull(value), j.frames = 0;
+				else if (key == "frames") j.frames = stoull(value), j.cycles = 0;
+				else if (key == "ipf") j.instructionsPerFrame = stoi(value);
+				else if (key == "seed") j.seed = stoull(value);
+				else if (key == "movie" && !value.empty()) j.play = (base / value).string();
+				else if (key == "check" && value.find(':') != string::npos)
+				{
+					size_t colon = value.find(':');
+					j.checks.push_back({ stoull(value.substr(0, colon)), stoull(value.substr(colon + 1), nullptr, 0) });
+				}
+				else if (key == "ips") j.ips = stod(value);
+				else if (key == "engine" && parseEngine(value, j.engine)) continue;
+				else
+				{
+					cout << "ERROR: " << path << ":" << lineNumber << ": Unknown option " << token << endl;
+					return false;
+				}
+			}
+			catch (logic_error const&)
+			{
+				cout << "ERROR: " << path << ":" << lineNumber << ": Got invalid argument " << token << endl;
+				return false;
+			}
+		}
+		if (j.instructionsPerFrame <= 0 || (j.budget() == 0 && j.play.empty()))
+		{
+			cout << "ERROR: " << path << ":" << lineNumber << ": No cycles or frames specified" << endl;
+			return false;
+		}
+		jobs.push_back(j);
+	}
+	return true;
+}
+
+static string status(result const& r)
+{
+	if (!r.loaded) return "load failed";
+	if (!r.errors.empty()) return "error";
+	if (!r.failures.empty()) return "failed";
+	return r.stopped ? "stopped" : "running";
+}
+
+static string csvField(string const& text)
+{
+	if (text.find_first_of(",\"\n") == string::npos) return text;
+	string res = "\"";
+	for (char c : text)
+	{
+		if (c == '"') res += '"';
+		res += c;
+	}
+	return res + "\"";
+}
+
+static string jsonString(string const& text)
+{
+	string res = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\') res += '\\';
+		if ((unsigned char)c < 0x20) res += "\\u" + type_to_hex((uint16_t)c).substr(2);
+		else res += c;
+	}
+	return res + "\"";
+}
+
+static void writeCsv(ostream& out, vector<job> const& jobs, vector<result> const& results)
+{
+	out << "rom,engine,seed,instructions,ms,executed_ips,display_hash,invalidated,idle,status,errors,failures" << endl;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		result const& r = results[i];
+		string errors, failures;
+		for (string const& e : r.errors) errors += (errors.empty() ? "" : "; ") + e;
+		for (string const& f : r.failures) failures += (failures.empty() ? "" : "; ") + f;
+		out << csvField(jobs[i].path) << "," << engineNames[(int)jobs[i].engine] << ","
+			<< r.seed << "," << r.executed << "," << fixed << setprecision(3) << r.seconds * 1000 << ","
+			<< setprecision(0) << r.ips() << ","
+			<< type_to_hex(r.hash) << "," << r.invalidated << "," << r.idle << "," << status(r) << "," << csvField(errors) << "," << csvField(failures) << endl;
+	}
+}
+
+static void writeJson(ostream& out, vector<job> const& jobs, vector<result> const& results)
+{
+	out << "[" << endl;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		result const& r = results[i];
+		out << "  { \"rom\": " << jsonString(jobs[i].path)
+			<< ", \"engine\": \"" << engineNames[(int)jobs[i].engine] << "\""
+			<< ", \"seed\": " << r.seed
+			<< ", \"instructions\": " << r.executed
+			<< ", \"ms\": " << fixed << setprecision(3) << r.seconds * 1000
+			<< ", \"executed_ips\": " << setprecision(0) << r.ips()
+			<< ", \"display_hash\": \"" << type_to_hex(r.hash) << "\""
+			<< ", \"invalidated\": " << r.invalidated
+			<< ", \"idle\": " << r.idle
+			<< ", \"status\": \"" << status(r) << "\", \"errors\": [";
+		for (size_t e = 0; e < r.errors.size(); e++) out << (e ? ", " : "") << jsonString(r.errors[e]);
+		out << "], \"failures\": [";
+		for (size_t f = 0; f < r.failures.size(); f++) out << (f ? ", " : "") << jsonString(r.failures[f]);
+		out << "] }" << (i + 1 < jobs.size() ? "," : "") << endl;
+	}
+	out << "]" << endl;
+}
+
+// A manifest that repeats the jobs and checks every display hash sample and the speed.
+// Jobs that failed aren't worth checking against and are left out
+static bool writeGolden(string const& path, vector<job> const& jobs, vector<result> const& results)
+{
+	namespace fs = std::filesystem;
+	ofstream out(path);
+	if (!out)
+	{
+		cout << "ERROR: Can't write " << path << endl;
+		return false;
+	}
+	fs::path base = fs::absolute(path).parent_path();
+	out << "# Written by chip8-run --golden, run with chip8-run -b " << fs::path(path).filename().string() << endl;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		job const& j = jobs[i];
+		result const& r = results[i];
+		if (!r.loaded || !r.errors.empty() || !r.failures.empty()) continue;
+
+		out << fs::relative(fs::absolute(j.path), base).string();
+		if (j.cycles) out << " cycles=" << j.cycles;
+		if (j.frames) out << " frames=" << j.frames;
+		out << " ipf=" << j.instructionsPerFrame << " engine=" << engineNames[(int)j.engine];
+		if (j.play.empty()) out << " seed=" << j.seed;
+		else out << " movie=" << fs::relative(fs::absolute(j.play), base).string();
+		for (auto const& sample : r.hashes) out << " check=" << sample.first << ":" << type_to_hex(sample.second);
+		if (r.seconds > 0) out << " ips=" << fixed << setprecision(0) << r.ips();
+		out << endl;
+	}
+	return true;
+}
+
+// "-" is the standard output
+static bool writeReport(string const& path, void (*write)(ostream&, vector<job> const&, vector<result> const&),
+	vector<job> const& jobs, vector<result> const& results)
+{
+	if (path == "-")
+	{
+		write(cout, jobs, results);
+		return true;
+	}
+	ofstream out(path);
+	if (!out)
+	{
+		cout << "ERROR: Can't write " << path << endl;
+		return false;
+	}
+	write(out, jobs, results);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> args;
+	size_t argIndex; // Macros requirement
+	for (int i = 0; i < argc; i++)
+	{
+		args.push_back(argv[i]);
+	}
+
+	if (ARGS_FIND(args, "-h") || ARGS_FIND(args, "--help"))
+	{
+		cout << "Usage: " << endl
+			<< "  -h [ --help ]              shows this message" << endl
+			<< "  -p [ --path ] file         path to ROM" << endl
+			<< "  -c [ --cycles ] N          run N instructions" << endl
+			<< "  -f [ --frames ] N          run N frames (60 Hz timer ticks)" << endl
+			<< "  --ipf N (=10)              instructions per frame" << endl
+			<< "  -e [ --engine ] name       interpreter (default), cached, block, jit or aot; all runs" << endl
+			<< "                             every --batch ROM with each engine but aot" << endl
+			<< "  -s [ --seed ] N (=0)       seed of the random number generator" << endl
+			<< "  -q [ --quiet ]             don't print ROM log messages" << endl
+			<< "  --no-idle                  execute idle loops (waiting for a key or the delay timer)" << endl
+			<< "                             instead of skipping them" << endl
+			<< "  --loops                    stop at any loop that can't end (same state again, no key" << endl
+			<< "                             or timer in it), not only at a jump to itself" << endl
+			<< "  --play file                play an input movie (its seed, runs to its end by default)" << endl
+			<< "  --record file              record the input into a movie" << endl
+			<< "  -b [ --batch ] path        run every .ch8 in a directory or every ROM of a manifest" << endl
+			<< "  -j [ --threads ] N         worker threads for --batch (default: all cores)" << endl
+			<< "  --csv file                 write --batch results as CSV (- for stdout, the default)" << endl
+			<< "  --json file                write --batch results as JSON (- for stdout)" << endl
+			<< "  --golden file              write a manifest checking the --batch results (hashes and speed)" << endl
+			<< "  --checkpoint N             sample the display hash every N instructions for --golden" << endl
+			<< "  --tolerance N (=25)        percent below the manifest's ips=N that still passes" << endl;
+		return 0;
+	}
+
+	bool pathFound = ARGS_FIND(args, "-p") || ARGS_FIND(args, "--path");
+	size_t pathIndex = argIndex + 1;
+	bool cyclesFound = ARGS_FIND(args, "-c") || ARGS_FIND(args, "--cycles");
+	size_t cyclesIndex = argIndex + 1;
+	bool framesFound = ARGS_FIND(args, "-f") || ARGS_FIND(args, "--frames");
+	size_t framesIndex = argIndex + 1;
+	bool ipfFound = ARGS_FIND(args, "--ipf");
+	size_t ipfIndex = argIndex + 1;
+	bool engineFound = ARGS_FIND(args, "-e") || ARGS_FIND(args, "--engine");
+	size_t engineIndex = argIndex + 1;
+	bool seedFound = ARGS_FIND(args, "-s") || ARGS_FIND(args, "--seed");
+	size_t seedIndex = argIndex + 1;
+	bool quiet = ARGS_FIND(args, "-q") || ARGS_FIND(args, "--quiet");
+	bool loopsFound = ARGS_FIND(args, "--loops");
+	bool noIdleFound = ARGS_FIND(args, "--no-idle");
+	bool batchFound = ARGS_FIND(args, "-b") || ARGS_FIND(args, "--batch");
+	size_t batchIndex = argIndex + 1;
+	bool threadsFound = ARGS_FIND(args, "-j") || ARGS_FIND(args, "--threads");
+	size_t threadsIndex = argIndex + 1;
+	bool csvFound = ARGS_FIND(args, "--csv");
+	size_t csvIndex = argIndex + 1;
+	bool jsonFound = ARGS_FIND(args, "--json");
+	size_t jsonIndex = argIndex + 1;
+	bool playFound = ARGS_FIND(args, "--play");
+	size_t playIndex = argIndex + 1;
+	bool recordFound = ARGS_FIND(args, "--record");
+	size_t recordIndex = argIndex + 1;
+	bool goldenFound = ARGS_FIND(args, "--golden");
+	size_t goldenIndex = argIndex + 1;
+	bool checkpointFound = ARGS_FIND(args, "--checkpoint");
+	size_t checkpointIndex = argIndex + 1;
+	bool toleranceFound = ARGS_FIND(args, "--tolerance");
+	size_t toleranceIndex = argIndex + 1;
+
+	if (pathFound == batchFound)
+	{
+		cout << "ERROR: Specify either a ROM or a batch" << endl;
+		return 1;
+	}
+	// Manifest lines can set their own budget, a movie has its own length
+	if ((cyclesFound && framesFound) || (!batchFound && !playFound && !cyclesFound && !framesFound))
+	{
+		cout << "ERROR: Specify either cycles or frames" << endl;
+		return 1;
+	}
+	if ((pathFound && pathIndex >= args.size()) || (batchFound && batchIndex >= args.size())
+		|| (cyclesFound && cyclesIndex >= args.size()) || (framesFound && framesIndex >= args.size())
+		|| (ipfFound && ipfIndex >= args.size()) || (engineFound && engineIndex >= args.size())
+		|| (threadsFound && threadsIndex >= args.size()) || (csvFound && csvIndex >= args.size())
+		|| (jsonFound && jsonIndex >= args.size()) || (seedFound && seedIndex >= args.size())
+		|| (playFound && playIndex >= args.size()) || (recordFound && recordIndex >= args.size())
+		|| (goldenFound && goldenIndex >= args.size()) || (checkpointFound && checkpointIndex >= args.size())
+		|| (toleranceFound && toleranceIndex >= args.size()))
+	{
+		cout << "ERROR: No value specified" << endl;
+		return 1;
+	}
+
+	job defaults;
+	defaults.detectLoops = loopsFound;
+	defaults.fastForward = !noIdleFound;
+	int threads = 0;
+	try
+	{
+		if (ipfFound) defaults.instructionsPerFrame = stoi(args[ipfIndex]);
+		if (cyclesFound) defaults.cycles = stoull(args[cyclesIndex]);
+		if (framesFound) defaults.frames = stoull(args[framesIndex]);
+		if (seedFound) defaults.seed = stoull(args[seedIndex]);
+		if (threadsFound) threads = stoi(args[threadsIndex]);
+		if (checkpointFound) defaults.checkpoint = stoull(args[checkpointIndex]);
+		if (toleranceFound) defaults.tolerance = stod(args[toleranceIndex]);
+	}
+	catch (logic_error const& e)
+	{
+		cout << "ERROR: Got invalid argument" << endl;
+		return 1;
+	}
+	if (defaults.instructionsPerFrame <= 0)
+	{
+		cout << "ERROR: Instructions per frame must be positive" << endl;
+		return 1;
+	}
+	if (threads < 0)
+	{
+		cout << "ERROR: Thread count can't be negative" << endl;
+		return 1;
+	}
+
+	if (batchFound && (playFound || recordFound))
+	{
+		cout << "ERROR: Movies of a batch are given in its manifest" << endl;
+		return 1;
+	}
+	if (!batchFound && goldenFound)
+	{
+		cout << "ERROR: --golden needs a batch" << endl;
+		return 1;
+	}
+	if (playFound) defaults.play = args[playIndex];
+	if (recordFound) defaults.record = args[recordIndex];
+
+	bool allEngines = engineFound && batchFound && args[engineIndex] == "all";
+	if (engineFound && !allEngines && !parseEngine(args[engineIndex], defaults.engine))
+	{
+		cout << "ERROR: Unknown engine " << args[engineIndex] << endl;
+		return 1;
+	}
+
+	if (batchFound)
+	{
+		vector<job> jobs;
+		if (!loadJobs(args[batchIndex], defaults, jobs)) return 1;
+		for (job const& j : jobs)
+		{
+			if (j.budget() == 0 && j.play.empty())
+			{
+				cout << "ERROR: No cycles or frames specified for " << j.path << endl;
+				return 1;
+			}
+		}
+		// Only the compiled-in aot code would tell it from the interpreter
+		if (allEngines)
+		{
+			vector<job> expanded;
+			for (job const& j : jobs)
+			{
+				for (CHIP8::engine e : { CHIP8::engine::interpreter, CHIP8::engine::cached, CHIP8::engine::block, CHIP8::engine::jit })
+				{
+					expanded.push_back(j);
+					expanded.back().engine = e;
+				}
+			}
+			jobs = move(expanded);
+		}
+
+		vector<result> results(jobs.size());
+		WorkPool pool(threads);
+		auto begin = chrono::steady_clock::now();
+		pool.run(jobs.size(), [&](size_t i) { results[i] = runJob(jobs[i], true); });
+		auto end = chrono::steady_clock::now();
+
+		if (!csvFound && !jsonFound && !writeReport("-", writeCsv, jobs, results)) return 1;
+		if (csvFound && !writeReport(args[csvIndex], writeCsv, jobs, results)) return 1;
+		if (jsonFound && !writeReport(args[jsonIndex], writeJson, jobs, results)) return 1;
+		if (goldenFound && !writeGolden(args[goldenIndex], jobs, results)) return 1;
+
+		size_t failed = count_if(results.begin(), results.end(),
+			[](result const& r) { return !r.loaded || !r.errors.empty() || !r.failures.empty(); });
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			for (string const& f : results[i].failures)
+				cerr << "FAILED: " << jobs[i].path << " (" << engineNames[(int)jobs[i].engine] << "): " << f << endl;
+		}
+		// Keeps stdout clean when a report goes there
+		cerr << "Jobs:    " << jobs.size() << endl
+			<< "Threads: " << min<size_t>(pool.size(), jobs.size()) << endl
+			<< "Steals:  " << pool.getSteals() << endl
+			<< "Time:    " << fixed << setprecision(3) << chrono::duration<double>(end - begin).count() * 1000 << " ms" << endl
+			<< "Failed:  " << failed << endl;
+		return failed ? 1 : 0;
+	}
+
+	defaults.path = args[pathIndex];
+	result r = runJob(defaults, quiet);
+	if (!r.loaded)
+	{
+		cout << "ERROR: Can't load ROM " << defaults.path << endl;
+		return 1;
+	}
+	// A run that can't follow its movie has nothing to report
+	if (!r.errors.empty() && !defaults.play.empty() && r.executed == 0)
+	{
+		if (quiet) cout << "ERROR: " << r.errors.front() << endl;
+		return 1;
+	}
+
+	cout << "ROM:          " << defaults.path << endl
+		<< "Instructions: " << r.executed << endl
+		<< "Time:         " << fixed << setprecision(3) << r.seconds * 1000 << " ms" << endl
+		<< "IPS:          " << setprecision(0) << r.ips() << " (executed, idle not counted)" << endl
+		<< "Seed:         " << r.seed << endl
+		<< "Display hash: " << type_to_hex(r.hash) << endl
+		<< "Invalidated:  " << r.invalidated << endl
+		<< "Idle:         " << r.idle << endl
+		<< "Status:       " << (r.stopped ? "stopped (endless loop or error)" : "running") << endl;
+	if (r.stopped && r.errors.empty())
+		cout << "Loop:         " << showbase << hex << r.loop.start << "-" << r.loop.end << dec << endl;
+
+	return 0;
+}
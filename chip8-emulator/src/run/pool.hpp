@@ -0,0 +1,113 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a fixed set of jobs on worker threads. Each worker takes jobs from the back of
+// its own queue and, when that runs dry, steals from the front of the others, so a few
+// long ROMs don't leave the rest of the cores idle
+class WorkPool
+{
+	struct queue
+	{
+		std::mutex lock;
+		std::deque<size_t> jobs;
+	};
+
+	unsigned threads;
+	std::atomic<unsigned long long> steals{ 0 };
+
+	static bool take(queue& q, bool back, size_t& job)
+	{
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.jobs.empty()) return false;
+		if (back)
+		{
+			job = q.jobs.back();
+			q.jobs.pop_back();
+		}
+		else
+		{
+			job = q.jobs.front();
+			q.jobs.pop_front();
+		}
+		return true;
+	}
+
+public:
+	explicit WorkPool(unsigned threads = 0)
+		: threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+	{
+	}
+
+	// Calls job(i) for every i < count, returns when all of them finished.
+	// No jobs are added while running, so a worker that finds every queue empty is done
+	void run(size_t count, std::function<void(size_t)> const& job)
+	{
+		unsigned workers = (unsigned)std::min<size_t>(threads, count);
+		if (workers == 0) return;
+
+		std::vector<queue> queues(workers);
+		for (size_t i = 0; i < count; i++) queues[i % workers].jobs.push_back(i);
+
+		auto worker = [&](unsigned self)
+		{
+			size_t index;
+			for (;;)
+			{
+				if (take(queues[self], true, index))
+				{
+					job(index);
+					continue;
+				}
+				bool stolen = false;
+				for (unsigned i = 1; i < workers && !stolen; i++)
+					stolen = take(queues[(self + i) % workers], false, index);
+				if (!stolen) return;
+				steals++;
+				job(index);
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned i = 1; i < workers; i++) pool.emplace_back(worker, i);
+		worker(0);
+		for (std::thread& t : pool) t.join();
+	}
+
+	unsigned size() const { return threads; }
+	unsigned long long getSteals() const { return steals; }
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Lock-free handoff between the emulation thread and the GUI thread
+
+// The writer fills write() and publishes it, the reader takes the newest published copy.
+// Neither side waits: copies the reader didn't take are overwritten
+template<class T>
+class TripleBuffer
+{
+	static constexpr int FRESH = 4; // In middle: published since the reader last took it
+
+	std::array<T, 3> slots;
+	int back = 0; // Writer's
+	alignas(64) std::atomic<int> middle{ 1 };
+	alignas(64) int front = 2; // Reader's
+
+public:
+	T& write() { return slots[back]; }
+	void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3; }
+
+	bool update() // False if nothing was published since the last call
+	{
+		if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+	T const& read() const { return slots[front]; }
+};
+
+// Bounded queue for one producer thread and one consumer thread. N is a power of two
+template<class T, size_t N>
+class SpscQueue
+{
+	static_assert(N && (N & (N - 1)) == 0, "Size must be a power of two");
+
+	std::array<T, N> items;
+	alignas(64) std::atomic<size_t> head{ 0 }; // Next to pop
+	alignas(64) std::atomic<size_t> tail{ 0 }; // Next to push
+
+public:
+	bool push(T item) // False if full
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N) return false;
+		items[t & (N - 1)] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item) // False if empty
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		item = std::move(items[h & (N - 1)]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+#endif
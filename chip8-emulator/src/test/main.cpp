@@ -0,0 +1,324 @@
+/*
+chip8-emulator v1.0 - CHIP-8 emulator.
+Copyright(C) 2021, 2022 Ruslan Popov <ruslanpopov1512@gmail.com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// chip8-test - tests of the core that the golden manifests of chip8-run can't express:
+// properties of the reverse debugger and the engines. Prints a line per test,
+// the exit code is 1 if any failed
+
+#include "../common.h"
+#include "../chip8/CHIP8.hpp"
+#include "../chip8/CHIP8Batch.hpp"
+#include "../chip8/rng.hpp"
+
+#include <functional>
+
+// The example ROMs; the build recompiles them into this program with chip8-recomp. Relative
+// to chip8-emulator, the working directory of the Visual Studio project
+#ifndef CHIP8_EXAMPLES
+#define CHIP8_EXAMPLES "../chip8-assembler/examples"
+#endif
+
+using namespace std;
+
+struct test
+{
+	string name;
+	function<string()> run; // Returns what went wrong, empty if it passed
+};
+
+// A machine with code at 0x200, as chip8-bench makes them
+static CHIP8::state program(vector<uint16_t> const& code)
+{
+	CHIP8 c;
+	CHIP8::state s;
+	c.saveState(s);
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		s.ram[0x200 + i * 2] = code[i] >> 8;
+		s.ram[0x200 + i * 2 + 1] = code[i] & 0xFF;
+	}
+	return s;
+}
+
+static double seconds(function<void()> work)
+{
+	auto begin = chrono::steady_clock::now();
+	work();
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// A breakpoint that is never hit replays every segment between checkpoints once:
+// four times the history takes about four times as long, not sixteen
+static string reverseContinueWithoutHit()
+{
+	CHIP8::state s = program({ 0x7001, 0x7102, 0x1200 }); // ADD V0, 1 / ADD V1, 2 / JP 0x200
+	double times[2];
+	unsigned long long const lengths[2] = { 500000, 2000000 };
+	for (int i = 0; i < 2; i++)
+	{
+		CHIP8 c;
+		c.loadState(s);
+		c.setCheckpointInterval(10000);
+		c.run(lengths[i]);
+		bool hit = true;
+		times[i] = seconds([&] { hit = c.reverseContinue(0x300); });
+		if (hit) return "reported a hit of an address never executed";
+		if (c.getCycles() != 0 || c.getPC() != 0x200) return "didn't stop at the first checkpoint, cycle " + to_string(c.getCycles());
+	}
+	if (times[1] > 8 * max(times[0], 1e-3))
+		return "not linear: " + to_string(times[0]) + " s for " + to_string(lengths[0]) + " cycles, "
+			+ to_string(times[1]) + " s for " + to_string(lengths[1]);
+	return "";
+}
+
+// Random code: valid instructions with operands that stay near the code, and some random words
+static vector<uint16_t> randomCode(pcg32& g, int length)
+{
+	static int const fx[] = { 0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65 };
+	static int const alu[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+	vector<uint16_t> code;
+	for (int i = 0; i < length; i++)
+	{
+		uint16_t x = g.next() % 16 << 8, y = g.next() % 16 << 4, nn = g.next() % 256;
+		uint16_t addr = 0x200 + g.next() % length * 2;
+		switch (g.next() % 16)
+		{
+		case 0: code.push_back(g.next() % 2 ? 0x00E0 : 0x00EE); break;
+		case 1: code.push_back(0x1000 | addr); break;
+		case 2: code.push_back(0x2000 | addr); break;
+		case 3: code.push_back((g.next() % 2 ? 0x3000 : 0x4000) | x | nn); break;
+		case 4: code.push_back((g.next() % 2 ? 0x5000 : 0x9000) | x | y); break;
+		case 5: case 6: code.push_back((g.next() % 2 ? 0x6000 : 0x7000) | x | nn); break;
+		case 7: case 8: code.push_back(0x8000 | x | y | alu[g.next() % 9]); break;
+		case 9: code.push_back(0xA000 | (g.next() % 2 ? addr : 0x300 + g.next() % 0x100)); break;
+		case 10: code.push_back(0xB000 | addr); break;
+		case 11: code.push_back(0xC000 | x | nn); break;
+		case 12: code.push_back(0xD000 | x | y | g.next() % 16); break;
+		case 13: code.push_back(0xE09E | x | (g.next() % 2 ? 0 : 0x3F)); break;
+		case 14: code.push_back(0xF000 | x | fx[g.next() % 9]); break;
+		default: code.push_back(g.next() & 0xFFFF); break;
+		}
+	}
+	return code;
+}
+
+static bool sameMachine(CHIP8 const& a, CHIP8 const& b)
+{
+	if (a.regInfo() != b.regInfo() || a.displayHash() != b.displayHash() || a.getCycles() != b.getCycles()
+		|| a.caughtEndlessLoop() != b.caughtEndlessLoop())
+		return false;
+	for (int addr = 0; addr < 4096; addr++)
+		if (a.getFromRam(addr) != b.getFromRam(addr)) return false;
+	return true;
+}
+
+// Every engine runs random code (self-modifying included) with random keys and timer ticks
+// exactly like the interpreter, compared after every slice
+static string enginesAgree()
+{
+	CHIP8::engine const engines[] = { CHIP8::engine::cached, CHIP8::engine::block, CHIP8::engine::jit };
+	char const* const names[] = { "cached", "block", "jit" };
+	int programs = 0;
+	for (uint64_t seed = 0; programs < 100; seed++)
+	{
+		pcg32 g;
+		g.seed(seed);
+		CHIP8::state s = program(randomCode(g, 64 + g.next() % 192));
+		// Most random code stops on a stack error at once, keep the code that runs for a while
+		CHIP8 probe;
+		probe.setSeed(seed);
+		probe.loadState(s);
+		for (int i = 0; i < 2000 && !probe.caughtEndlessLoop(); i++) probe.emulateCycle();
+		if (probe.caughtEndlessLoop()) continue;
+		programs++;
+		for (int e = 0; e < 3; e++)
+		{
+			CHIP8 reference, c;
+			c.setEngine(engines[e]);
+			for (CHIP8* m : { &reference, &c })
+			{
+				m->setSeed(seed);
+				m->loadState(s);
+			}
+			pcg32 inputs;
+			inputs.seed(seed, 1);
+			for (int slice = 0; slice < 400 && !reference.caughtEndlessLoop(); slice++)
+			{
+				int key = inputs.next() % 16;
+				bool down = inputs.next() % 2 != 0;
+				unsigned long long count = 1 + inputs.next() % 97;
+				for (CHIP8* m : { &reference, &c })
+				{
+					if (down) m->setKey(key);
+					else m->unsetKey(key);
+				}
+				for (unsigned long long i = 0; i < count; i++) reference.emulateCycle();
+				c.run(count);
+				reference.tickTimers();
+				c.tickTimers();
+				if (!sameMachine(reference, c))
+					return string(names[e]) + " differs from the interpreter on program " + to_string(seed)
+						+ " at cycle " + to_string(reference.getCycles());
+			}
+		}
+	}
+	return "";
+}
+
+// The example ROMs recompiled at build time run like the interpreter, so chip8-recomp
+// and the instruction table it decodes with can't drift apart
+static string aotAgrees()
+{
+	for (string const name : { "chip8calc", "chip8start", "dumbArcanoid" })
+	{
+		string path = string(CHIP8_EXAMPLES) + "/" + name + ".ch8";
+		CHIP8 reference, c;
+		c.setEngine(CHIP8::engine::aot);
+		string log;
+		c.logCallback = [&log](string const& text) { log += text + "\n"; };
+		if (!reference.reload(path) || !c.reload(path)) return "can't load " + path;
+
+		pcg32 inputs;
+		inputs.seed(1);
+		for (int frame = 0; frame < 20000 && !reference.caughtEndlessLoop(); frame++)
+		{
+			if (frame % 30 == 0)
+			{
+				int key = inputs.next() % 16;
+				bool down = inputs.next() % 2 != 0;
+				for (CHIP8* m : { &reference, &c })
+				{
+					if (down) m->setKey(key);
+					else m->unsetKey(key);
+				}
+			}
+			reference.run(10);
+			c.run(10);
+			reference.tickTimers();
+			c.tickTimers();
+			if (reference.getCycles() != c.getCycles() || reference.displayHash() != c.displayHash())
+				return name + " differs from the interpreter at cycle " + to_string(reference.getCycles()) + "\n" + log;
+		}
+		if (log.find("No recompiled code") != string::npos) return name + " wasn't recompiled into chip8-test";
+	}
+	return "";
+}
+
+// Every lane of a CHIP8Batch runs like a CHIP8 of its own: the example ROMs in 40 lanes whose
+// seeds and keys split them into groups that part and meet again, compared after every frame
+static string batchAgrees()
+{
+	int const lanes = 40;
+	for (string const name : { "chip8calc", "chip8start", "dumbArcanoid" })
+	{
+		string path = string(CHIP8_EXAMPLES) + "/" + name + ".ch8";
+		CHIP8Batch batch(lanes);
+		vector<unique_ptr<CHIP8>> single;
+		for (int lane = 0; lane < lanes; lane++)
+		{
+			batch.setSeed(lane, lane % 3);
+			single.push_back(make_unique<CHIP8>());
+			single[lane]->setSeed(lane % 3);
+			if (!single[lane]->reload(path)) return "can't load " + path;
+		}
+		if (!batch.reload(path)) return "can't load " + path;
+
+		pcg32 inputs;
+		inputs.seed(2);
+		for (int frame = 0; frame < 3000; frame++)
+		{
+			if (frame % 30 == 0)
+			{
+				// Lanes l and l + 4 get the same keys
+				int keys[4];
+				bool down[4];
+				for (int i = 0; i < 4; i++)
+				{
+					keys[i] = inputs.next() % 16;
+					down[i] = inputs.next() % 2 != 0;
+				}
+				for (int lane = 0; lane < lanes; lane++)
+				{
+					if (down[lane % 4])
+					{
+						batch.setKey(lane, keys[lane % 4]);
+						single[lane]->setKey(keys[lane % 4]);
+					}
+					else
+					{
+						batch.unsetKey(lane, keys[lane % 4]);
+						single[lane]->unsetKey(keys[lane % 4]);
+					}
+				}
+			}
+			batch.run(10);
+			batch.tickTimers();
+			for (int lane = 0; lane < lanes; lane++)
+			{
+				CHIP8& c = *single[lane];
+				c.run(10);
+				c.tickTimers();
+				CHIP8::state s;
+				c.saveState(s);
+				bool same = batch.stopped(lane) == c.caughtEndlessLoop() && batch.getCycles(lane) == c.getCycles()
+					&& batch.getPC(lane) == s.pc && batch.getI(lane) == s.I && batch.displayHash(lane) == c.displayHash();
+				for (int i = 0; i < 16; i++) same = same && batch.getV(lane, i) == s.v[i];
+				if (frame == 2999)
+					for (int addr = 0; addr < 4096; addr++) same = same && batch.getFromRam(lane, addr) == s.ram[addr];
+				if (!same)
+					return name + " lane " + to_string(lane) + " differs from a CHIP8 at cycle " + to_string(c.getCycles());
+			}
+		}
+		if (batch.getStatistics().vectorLanes == 0) return name + ": the lanes never ran together";
+	}
+	return "";
+}
+
+static vector<test> const tests =
+{
+	{ "reverse-continue/no-hit", reverseContinueWithoutHit },
+	{ "engines/agree", enginesAgree },
+	{ "engines/aot-examples", aotAgrees },
+	{ "batch/lanes", batchAgrees },
+};
+
+int main(int argc, char** argv)
+{
+	string filter = argc > 1 ? argv[1] : ""; // Runs only the tests with this in the name
+	int failed = 0;
+	for (test const& t : tests)
+	{
+		if (t.name.find(filter) == string::npos) continue;
+		string error = t.run();
+		if (error.empty()) cout << "ok      " << t.name << endl;
+		else
+		{
+			cout << "FAILED: " << t.name << ": " << error << endl;
+			failed++;
+		}
+	}
+	cout << "Failed:  " << failed << endl;
+	return failed ? 1 : 0;
+}